@@ -0,0 +1,67 @@
+# Copyright (c) 2015
+# Guillaume Lemaitre (g.lemaitre58@gmail.com)
+# Francois Rameau
+# Devesh Adlakha
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the Free
+# Software Foundation; either version 2 of the License, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+# more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+# Settings and sources shared by the driver, the benchmarks and the panorama tool
+
+# QtGui decodes the JPEG frames of the change detector and the panorama
+QT       += core network gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+SOURCES += $$PWD/src/sonysncrx550n.cpp \
+           $$PWD/src/scanplanner.cpp \
+           $$PWD/src/framewriter.cpp \
+           $$PWD/src/spherearchive.cpp \
+           $$PWD/src/mjpegstream.cpp \
+           $$PWD/src/camerafleet.cpp \
+           $$PWD/src/requestmetrics.cpp \
+           $$PWD/src/ptzcodec.cpp \
+           $$PWD/src/acquisitionjournal.cpp \
+           $$PWD/src/cameraworker.cpp \
+           $$PWD/src/changedetector.cpp \
+           $$PWD/src/patrolscheduler.cpp \
+           $$PWD/src/panoramabuilder.cpp \
+           $$PWD/src/requesttrace.cpp
+
+HEADERS += $$PWD/src/sonysncrx550n.h \
+           $$PWD/src/scanplanner.h \
+           $$PWD/src/framewriter.h \
+           $$PWD/src/spherearchive.h \
+           $$PWD/src/mjpegstream.h \
+           $$PWD/src/camerafleet.h \
+           $$PWD/src/requestmetrics.h \
+           $$PWD/src/ptzcodec.h \
+           $$PWD/src/acquisitionjournal.h \
+           $$PWD/src/cameraworker.h \
+           $$PWD/src/changedetector.h \
+           $$PWD/src/patrolscheduler.h \
+           $$PWD/src/panoramabuilder.h \
+           $$PWD/src/requesttrace.h
+
+INCLUDEPATH += $$PWD/src
+             
+# Support c++11
+QMAKE_CXXFLAGS += -std=c++11
+
+# Configuration via pkg-config
+#CONFIG += link_pkgconfig
+
+# Add the library needed
+#PKGCONFIG += opencv eigen3
@@ -17,25 +17,18 @@
 # with this program; if not, write to the Free Software Foundation, Inc., 51
 # Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
-QT       += core network
-QT       -= gui
+# The driver, the benchmarks, the panorama tool and the tests share their sources through
+# driver-sony-snc-rx550n.pri
+TEMPLATE = subdirs
 
-TARGET = driver
-CONFIG   += console
-CONFIG   -= app_bundle
+SUBDIRS = driver \
+          benchmark \
+          codec_benchmark \
+          panorama \
+          queue_test
 
-TEMPLATE = app
-
-SOURCES += ./src/sonysncrx550n.cpp \
-           ./src/main.cpp 
-
-HEADERS += ./src/sonysncrx550n.h
-             
-# Support c++11
-QMAKE_CXXFLAGS += -std=c++11
-
-# Configuration via pkg-config
-#CONFIG += link_pkgconfig
-
-# Add the library needed
-#PKGCONFIG += opencv eigen3
+driver.file = driver.pro
+benchmark.file = benchmark.pro
+codec_benchmark.file = codec_benchmark.pro
+panorama.file = panorama.pro
+queue_test.file = queue_test.pro
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "acquisitionjournal.h"
+
+// qt library
+#include <QLatin1String>
+
+// stl library
+#include <iostream>
+
+AcquisitionJournal::AcquisitionJournal(const QString& _filename) : file(_filename) {
+}
+
+// Open the journal and load the records written, up to the first torn one
+bool AcquisitionJournal::open() {
+  if (file.isOpen())
+    return true;
+  if (!file.open(QIODevice::ReadWrite)) {
+    std::cout << "Error while opening the journal file" << std::endl;
+    return false;
+  }
+  planned.clear();
+  planned_keys.clear();
+  completed.clear();
+  const QByteArray content = file.readAll();
+  const int record_count = content.size() / static_cast<int> (sizeof(AcquisitionJournalRecord));
+  int valid_count = 0;
+  for (; valid_count < record_count; ++valid_count) {
+    const AcquisitionJournalRecord& record = reinterpret_cast<const AcquisitionJournalRecord*> (content.constData())[valid_count];
+    if (record.checksum != record_checksum(record))
+      break;
+    PtzPose pose = {record.pan_steps, record.tilt_steps, record.zoom_code, record.focus_code};
+    const quint64 key = PtzCodec::pose_key(pose);
+    if (record.kind == planned_record) {
+      if (!planned_keys.contains(key)) {
+	planned.push_back(pose);
+	planned_keys.insert(key);
+      }
+    }
+    else if (record.kind == completed_record)
+      completed.insert(key);
+    else
+      break;
+  }
+  // Drop the torn tail, the next records follow the last valid one
+  const qint64 valid_size = static_cast<qint64> (valid_count) * sizeof(AcquisitionJournalRecord);
+  if (valid_size != file.size()) {
+    std::cout << "The journal was not closed properly !!! " << (file.size() - valid_size) << " bytes dropped !!!" << std::endl;
+    file.resize(valid_size);
+  }
+  file.seek(valid_size);
+  return true;
+}
+
+void AcquisitionJournal::close() {
+  file.close();
+}
+
+// Append the poses of a scan in a single write
+bool AcquisitionJournal::plan(const std::vector<ScanPose>& _poses) {
+  if (!file.isOpen())
+    return false;
+  std::vector<AcquisitionJournalRecord> records;
+  records.reserve(_poses.size());
+  for (size_t i = 0; i < _poses.size(); ++i) {
+    const PtzPose pose = to_pose(_poses[i]);
+    const quint64 key = PtzCodec::pose_key(pose);
+    if (planned_keys.contains(key))
+      continue;
+    planned.push_back(pose);
+    planned_keys.insert(key);
+    records.push_back(make_record(planned_record, pose));
+  }
+  if (records.empty())
+    return true;
+  const qint64 size = static_cast<qint64> (records.size() * sizeof(AcquisitionJournalRecord));
+  if ((file.write(reinterpret_cast<const char*> (&records[0]), size) != size) || (!file.flush())) {
+    std::cout << "Error while writting the journal file" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Append the completion of a pose
+bool AcquisitionJournal::complete(const quint64 _key) {
+  if ((!file.isOpen()) || completed.contains(_key))
+    return file.isOpen();
+  completed.insert(_key);
+  const PtzPose pose = {static_cast<qint16> (_key >> 48), static_cast<qint16> ((_key >> 32) & 0xFFFF),
+			static_cast<quint16> ((_key >> 16) & 0xFFFF), static_cast<quint16> (_key & 0xFFFF)};
+  const AcquisitionJournalRecord record = make_record(completed_record, pose);
+  if ((file.write(reinterpret_cast<const char*> (&record), sizeof(record)) != static_cast<qint64> (sizeof(record))) || (!file.flush())) {
+    std::cout << "Error while writting the journal file" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Poses planned and not completed yet, in the order of the plan
+std::vector<ScanPose> AcquisitionJournal::get_missing_poses() const {
+  std::vector<ScanPose> missing;
+  for (size_t i = 0; i < planned.size(); ++i) {
+    const PtzPose& pose = planned[i];
+    if (completed.contains(PtzCodec::pose_key(pose)))
+      continue;
+    const char* zoom = PtzCodec::zoom_key(pose.zoom_code);
+    const char* focus = PtzCodec::focus_key(pose.focus_code);
+    // The journal was written from known positions
+    if ((zoom == 0) || (focus == 0))
+      continue;
+    ScanPose scan_pose = {PtzCodec::steps_to_pan(pose.pan_steps), PtzCodec::steps_to_tilt(pose.tilt_steps), QLatin1String(zoom), QLatin1String(focus)};
+    missing.push_back(scan_pose);
+  }
+  return missing;
+}
+
+// Key of a pose, as rounded to the motor steps
+quint64 AcquisitionJournal::pose_key(const ScanPose& _pose) {
+  return PtzCodec::pose_key(to_pose(_pose));
+}
+
+PtzPose AcquisitionJournal::to_pose(const ScanPose& _pose) {
+  PtzPose pose = {static_cast<qint16> (PtzCodec::pan_to_steps(_pose.pan)), static_cast<qint16> (PtzCodec::tilt_to_steps(_pose.tilt)),
+		  PtzCodec::zoom_code(_pose.zoom), PtzCodec::focus_code(_pose.focus)};
+  return pose;
+}
+
+AcquisitionJournalRecord AcquisitionJournal::make_record(const quint32 _kind, const PtzPose& _pose) {
+  AcquisitionJournalRecord record;
+  record.kind = _kind;
+  record.pan_steps = static_cast<qint16> (_pose.pan_steps);
+  record.tilt_steps = static_cast<qint16> (_pose.tilt_steps);
+  record.zoom_code = _pose.zoom_code;
+  record.focus_code = _pose.focus_code;
+  record.checksum = record_checksum(record);
+  return record;
+}
+
+// Check of the fields of a record, a torn record fails it
+quint32 AcquisitionJournal::record_checksum(const AcquisitionJournalRecord& _record) {
+  quint32 checksum = 0x9E3779B9u ^ _record.kind;
+  checksum = (checksum * 31u) ^ static_cast<quint16> (_record.pan_steps);
+  checksum = (checksum * 31u) ^ static_cast<quint16> (_record.tilt_steps);
+  checksum = (checksum * 31u) ^ _record.zoom_code;
+  checksum = (checksum * 31u) ^ _record.focus_code;
+  return checksum;
+}
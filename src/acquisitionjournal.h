@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ACQUISITIONJOURNAL_H_
+#define ACQUISITIONJOURNAL_H_
+
+// stl library
+#include <vector>
+
+// qt library
+#include <QString>
+#include <QFile>
+#include <QSet>
+
+#include "ptzcodec.h"
+#include "scanplanner.h"
+
+// The journal of an acquisition is a file of fixed size records, appended
+// when the poses of a scan are planned and each time the image of a pose
+// reaches the disk:
+//
+//   [planned][planned]...[planned][completed][completed]...
+//
+// A record torn by the death of the process is dropped when the journal is
+// opened again. The values are stored in the byte order of the host.
+
+// Record of the journal - 16 bytes
+struct AcquisitionJournalRecord {
+  quint32 kind;
+  // Position in motor steps and zoom and focus codes as sent to the camera
+  qint16 pan_steps;
+  qint16 tilt_steps;
+  quint16 zoom_code;
+  quint16 focus_code;
+  // Check of the other fields
+  quint32 checksum;
+};
+
+class AcquisitionJournal
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - the journal is neither created nor read before open()
+  explicit AcquisitionJournal(const QString& _filename);
+
+  // Open the journal, created if needed, and load the records written
+  bool open();
+  inline bool is_open() const { return file.isOpen(); }
+  void close();
+  inline QString get_filename() const { return file.fileName(); }
+
+  // Append the poses of a scan, the poses already planned are skipped
+  bool plan(const std::vector<ScanPose>& _poses);
+  // Append the completion of a pose, a single write without flushing to the
+  // disk - the records survive the death of the process, not of the machine
+  bool complete(const quint64 _key);
+
+  // Poses planned and not completed yet, in the order of the plan
+  std::vector<ScanPose> get_missing_poses() const;
+  inline int get_planned_count() const { return static_cast<int> (planned.size()); }
+  inline int get_completed_count() const { return completed.size(); }
+
+  // Key of a pose, as rounded to the motor steps
+  static quint64 pose_key(const ScanPose& _pose);
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  QFile file;
+  // Poses in the order of the plan
+  std::vector<PtzPose> planned;
+  QSet<quint64> planned_keys;
+  QSet<quint64> completed;
+
+  static const quint32 planned_record = 0x504E5953;    // "SYNP"
+  static const quint32 completed_record = 0x434E5953;  // "SYNC"
+
+  static PtzPose to_pose(const ScanPose& _pose);
+  static AcquisitionJournalRecord make_record(const quint32 _kind, const PtzPose& _pose);
+  static quint32 record_checksum(const AcquisitionJournalRecord& _record);
+
+  AcquisitionJournal(const AcquisitionJournal&);
+  AcquisitionJournal& operator=(const AcquisitionJournal&);
+};
+
+#endif  // ACQUISITIONJOURNAL_H_
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "benchmark.h"
+
+// qt library
+#include <QCoreApplication>
+
+// stl library
+#include <cstdlib>
+#include <iostream>
+
+Benchmark::Benchmark(SonySNCRX550N* _camera, QObject *parent) :
+  QObject(parent), camera(_camera), images(0), failures(0) {
+  connect(camera, SIGNAL(request_sent(quint64, bool)), this, SLOT(request_sent(quint64, bool)));
+  connect(camera, SIGNAL(request_finished(quint64, bool)), this, SLOT(request_finished(quint64, bool)));
+  connect(camera, SIGNAL(image_grabbed(quint64, QString)), this, SLOT(image_grabbed(quint64, QString)));
+}
+
+// Spherical acquisition on the given grid
+BenchmarkResult Benchmark::run_spherical_acquisition(const long _step_pan, const long _step_tilt, const long _speed, const QString& _directory_storage) {
+  camera->wait_for_idle();
+  const int poses = static_cast<int> (ScanPlanner::spherical_grid(_step_pan, _step_tilt, camera->get_zoom_position(), camera->get_focus_position()).size());
+  start_run();
+  camera->spherical_acquisition(_step_pan, _step_tilt, _speed, camera->get_zoom_position(), camera->get_focus_position(), _directory_storage);
+  camera->wait_for_idle();
+  // The images reach the disk after the last answer
+  camera->get_frame_writer()->wait_for_done();
+  QCoreApplication::processEvents();
+  return finish_run("spherical_acquisition", poses);
+}
+
+// Moves to random poses, one at a time and waiting for the head
+BenchmarkResult Benchmark::run_single_moves(const int _count, const long _speed) {
+  camera->wait_for_idle();
+  start_run();
+  std::srand(0);
+  for (int i = 0; i < _count; ++i) {
+    const double pan = -170.0 + 340.0 * std::rand() / RAND_MAX;
+    const double tilt = -45.0 + 90.0 * std::rand() / RAND_MAX;
+    camera->absolute_motion(pan, tilt, _speed);
+    camera->wait_for_settle();
+    camera->wait_for_idle();
+  }
+  return finish_run("single_moves", _count);
+}
+
+// Reset the measures of a new run
+void Benchmark::start_run() {
+  command_start.clear();
+  command_latencies.clear();
+  images = 0;
+  failures = 0;
+  clock.start();
+}
+
+// Build the result of the finished run
+BenchmarkResult Benchmark::finish_run(const QString& _name, const int _poses) {
+  BenchmarkResult result;
+  result.name = _name;
+  result.poses = _poses;
+  result.images = images;
+  result.failures = failures;
+  result.elapsed = clock.nsecsElapsed() / 1e9;
+  result.frames_per_second = (result.elapsed > 0.0) ? images / result.elapsed : 0.0;
+  result.poses_per_minute = (result.elapsed > 0.0) ? 60.0 * _poses / result.elapsed : 0.0;
+  result.command_p50 = RequestMetrics::percentile(command_latencies, 50.0);
+  result.command_p99 = RequestMetrics::percentile(command_latencies, 99.0);
+  return result;
+}
+
+// slot to time the commands leaving
+void Benchmark::request_sent(const quint64 _request_id, const bool _command) {
+  if (_command)
+    command_start.insert(_request_id, clock.nsecsElapsed());
+}
+
+// slot to measure the latency of the commands
+void Benchmark::request_finished(const quint64 _request_id, const bool _success) {
+  if (!_success)
+    ++failures;
+  auto it = command_start.find(_request_id);
+  if (it == command_start.end())
+    return;
+  command_latencies.push_back((clock.nsecsElapsed() - it.value()) / 1e6);
+  command_start.erase(it);
+}
+
+// slot to count the images stored
+void Benchmark::image_grabbed(const quint64 _request_id, const QString& _filename) {
+  Q_UNUSED(_request_id);
+  Q_UNUSED(_filename);
+  ++images;
+}
+
+// Print a result on a single line
+void Benchmark::print_result(const BenchmarkResult& _result) {
+  std::cout << _result.name.toStdString() << ": " << _result.poses << " poses - " << _result.images << " images - " << _result.failures << " failures in " << _result.elapsed << " s - "
+	    << _result.frames_per_second << " fps - " << _result.poses_per_minute << " poses/min - command latency p50 = " << _result.command_p50 << " ms - p99 = " << _result.command_p99 << " ms" << std::endl;
+}
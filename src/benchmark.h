@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+// stl library
+#include <vector>
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QElapsedTimer>
+
+#include "sonysncrx550n.h"
+
+// Result of a benchmark run
+struct BenchmarkResult {
+  QString name;
+  int poses;
+  int images;
+  int failures;
+  // Wall time of the run, in s
+  double elapsed;
+  double frames_per_second;
+  double poses_per_minute;
+  // Latency of the commands, from the request leaving to the answer, in ms
+  double command_p50;
+  double command_p99;
+};
+
+// End-to-end benchmark of the driver against a camera - usually the mock
+// camera. Each run drives the camera through its event loop and measures the
+// throughput of the images and the latency of the commands.
+class Benchmark : public QObject
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - the camera is not owned
+  explicit Benchmark(SonySNCRX550N* _camera, QObject *parent = 0);
+
+  // Spherical acquisition on the given grid, the images are stored in
+  // _directory_storage
+  BenchmarkResult run_spherical_acquisition(const long _step_pan, const long _step_tilt, const long _speed, const QString& _directory_storage);
+  // Moves to _count random poses, one at a time and waiting for the head
+  BenchmarkResult run_single_moves(const int _count, const long _speed);
+
+  // Print a result on a single line
+  static void print_result(const BenchmarkResult& _result);
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  SonySNCRX550N* camera;
+
+  // Private members regarding the running benchmark
+  QElapsedTimer clock;
+  // Time when each command left, in ns
+  QHash<quint64, qint64> command_start;
+  std::vector<double> command_latencies;
+  int images;
+  int failures;
+
+  // Reset the measures of a new run
+  void start_run();
+  // Build the result of the finished run
+  BenchmarkResult finish_run(const QString& _name, const int _poses);
+
+private slots:
+  // slot to time the commands leaving
+  void request_sent(const quint64 _request_id, const bool _command);
+  // slot to measure the latency of the commands
+  void request_finished(const quint64 _request_id, const bool _success);
+  // slot to count the images stored
+  void image_grabbed(const quint64 _request_id, const QString& _filename);
+};
+
+#endif  // BENCHMARK_H_
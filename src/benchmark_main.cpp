@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QHostAddress>
+#include <QStringList>
+
+#include "benchmark.h"
+#include "mockcamera.h"
+#include "requesttrace.h"
+#include "sonysncrx550n.h"
+
+#include <iostream>
+#include <cstdlib>
+
+// Create a directory of its own in the temporary directory, empty if it
+// cannot be created - Qt4 has no QTemporaryDir
+static QString make_temporary_directory() {
+  QByteArray path = QFile::encodeName(QDir::tempPath() + "/snc-benchmark-XXXXXX");
+  if (::mkdtemp(path.data()) == 0)
+    return QString();
+  return QFile::decodeName(path) + "/";
+}
+
+// Remove a directory and its content - Qt4 has no QDir::removeRecursively()
+static bool remove_directory(const QString& _path) {
+  QDir directory(_path);
+  if (!directory.exists())
+    return true;
+  bool success = true;
+  const QStringList subdirectories = directory.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+  for (int i = 0; i < subdirectories.size(); ++i)
+    success = remove_directory(directory.filePath(subdirectories.at(i))) && success;
+  const QStringList files = directory.entryList(QDir::Files);
+  for (int i = 0; i < files.size(); ++i)
+    success = directory.remove(files.at(i)) && success;
+  return directory.rmdir(directory.absolutePath()) && success;
+}
+
+// Usage: benchmark [--camera <ip>] [--latency <ms>] [--step-time <ms>]
+//                  [--zoom-time <ms>] [--jpeg-size <bytes>]
+//                  [--failure-rate <0..1>] [--drop-connection]
+//                  [--moves <count>] [--step-pan <count>] [--step-tilt <count>]
+//                  [--speed <1..24>] [--in-flight <count>]
+//                  [--metrics <file>] [--prometheus]
+//                  [--record <trace>] [--replay <trace>] [--max-speed]
+// Without --camera, the driver runs against a mock camera on localhost.
+// With --replay, the requests of a trace are sent again instead of the
+// benchmarks, at their recorded pace or at once with --max-speed, and the
+// replay recorded in <trace>.replay is compared with the trace.
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+
+  MockCameraConfig config = MockSonySNCRX550N::default_config();
+  QString camera_address;
+  int moves = 50;
+  long step_pan = 12;
+  long step_tilt = 8;
+  long speed = 24;
+  int in_flight = 4;
+  QString metrics_filename;
+  RequestMetrics::ExportFormat metrics_format = RequestMetrics::json_format;
+  QString record_filename;
+  QString replay_filename;
+  RequestTraceReplayer::ReplaySpeed replay_speed = RequestTraceReplayer::original_speed;
+  const QStringList args = a.arguments();
+  for (int i = 1; i < args.size(); ++i) {
+    const QString& option = args.at(i);
+    const QString value = (i + 1 < args.size()) ? args.at(i + 1) : QString();
+    if (option == "--drop-connection") {
+      config.drop_connection = true;
+      continue;
+    }
+    if (option == "--prometheus") {
+      metrics_format = RequestMetrics::prometheus_format;
+      continue;
+    }
+    if (option == "--max-speed") {
+      replay_speed = RequestTraceReplayer::maximum_speed;
+      continue;
+    }
+    if (value.isEmpty()) {
+      std::cout << "Missing value for " << option.toStdString() << std::endl;
+      return 1;
+    }
+    ++i;
+    if (option == "--camera")
+      camera_address = value;
+    else if (option == "--latency")
+      config.latency = value.toInt();
+    else if (option == "--step-time")
+      config.step_time = value.toDouble();
+    else if (option == "--zoom-time")
+      config.zoom_time = value.toInt();
+    else if (option == "--jpeg-size")
+      config.jpeg_size = value.toInt();
+    else if (option == "--failure-rate")
+      config.failure_rate = value.toDouble();
+    else if (option == "--moves")
+      moves = value.toInt();
+    else if (option == "--step-pan")
+      step_pan = value.toLong();
+    else if (option == "--step-tilt")
+      step_tilt = value.toLong();
+    else if (option == "--speed")
+      speed = value.toLong();
+    else if (option == "--in-flight")
+      in_flight = value.toInt();
+    else if (option == "--metrics")
+      metrics_filename = value;
+    else if (option == "--record")
+      record_filename = value;
+    else if (option == "--replay")
+      replay_filename = value;
+    else {
+      std::cout << "Unknown option " << option.toStdString() << std::endl;
+      return 1;
+    }
+  }
+
+  // Stand-in camera on localhost
+  MockSonySNCRX550N mock_cam;
+  if (camera_address.isEmpty()) {
+    mock_cam.set_config(config);
+    if (!mock_cam.listen(QHostAddress::LocalHost)) {
+      std::cout << "The mock camera can not listen: " << mock_cam.errorString().toStdString() << std::endl;
+      return 1;
+    }
+    camera_address = mock_cam.get_address();
+  }
+  std::cout << "Benchmark against " << camera_address.toStdString() << std::endl;
+
+  SonySNCRX550N sony_cam(camera_address);
+  sony_cam.set_max_in_flight(in_flight);
+  sony_cam.set_verbose(false);
+  Benchmark benchmark(&sony_cam);
+  // The images are stored in a directory of the run, removed at the end
+  const QString directory = make_temporary_directory();
+  if (directory.isEmpty()) {
+    std::cout << "The temporary directory of the images could not be created !!! Stopping the benchmark !!!" << std::endl;
+    return 1;
+  }
+
+  if (!replay_filename.isEmpty()) {
+    // Send the requests of the trace again and compare both runs
+    const QString replayed_filename = replay_filename + ".replay";
+    RequestTraceReplayer replayer(&sony_cam);
+    const bool replayed_trace = replayer.replay(replay_filename, replayed_filename, directory, replay_speed);
+    if (!remove_directory(directory))
+      std::cout << "The images of the replay could not be removed from " << directory.toStdString() << std::endl;
+    if (!replayed_trace)
+      return 1;
+    RequestTraceReader recorded(replay_filename);
+    RequestTraceReader replayed(replayed_filename);
+    if ((!recorded.load()) || (!replayed.load()))
+      return 1;
+    std::cout << "Replay of " << replay_filename.toStdString() << " recorded in " << replayed_filename.toStdString() << std::endl;
+    RequestTraceReplayer::print_comparison(recorded.summarize(), replayed.summarize());
+  }
+  else {
+    if ((!record_filename.isEmpty()) && (!sony_cam.start_trace(record_filename)))
+      return 1;
+    Benchmark::print_result(benchmark.run_single_moves(moves, speed));
+    Benchmark::print_result(benchmark.run_spherical_acquisition(step_pan, step_tilt, speed, directory));
+    // The images of the acquisition are only there to load the disk
+    if (!remove_directory(directory))
+      std::cout << "The images of the benchmark could not be removed from " << directory.toStdString() << std::endl;
+    if (sony_cam.is_tracing()) {
+      sony_cam.stop_trace();
+      std::cout << "Requests traced in " << record_filename.toStdString() << std::endl;
+    }
+  }
+  if ((!metrics_filename.isEmpty()) && sony_cam.get_metrics().dump(metrics_filename, metrics_format))
+    std::cout << "Metrics of the requests written in " << metrics_filename.toStdString() << std::endl;
+  if (mock_cam.isListening())
+    std::cout << "Mock camera: " << mock_cam.get_requests_served() << " requests served - " << mock_cam.get_failures_injected() << " failures injected" << std::endl;
+
+  return 0;
+}
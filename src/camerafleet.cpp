@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "camerafleet.h"
+
+// qt library
+#include <QEventLoop>
+#include <QtAlgorithms>
+
+// stl library
+#include <iostream>
+
+CameraFleet::CameraFleet(QObject *parent) :
+  QObject(parent), net_acc_manager(this), max_in_flight(4),
+  working(false), images_grabbed(0), bytes_at_start(0), report_interval(0) {
+  connect(&report_timer, SIGNAL(timeout()), this, SLOT(report_throughput()));
+}
+
+// The cameras and their streams use the replies of the network access
+// manager, which is destroyed before the children of the fleet
+CameraFleet::~CameraFleet() {
+  qDeleteAll(cameras);
+  cameras.clear();
+}
+
+// Add a camera on the shared network stack
+int CameraFleet::add_camera(const QString& _ip_address, const SonySNCRX550N::StartupMode _startup) {
+  SonySNCRX550N* sony_cam = new SonySNCRX550N(_ip_address, this, &net_acc_manager, _startup);
+  sony_cam->set_max_in_flight(max_in_flight);
+  connect(sony_cam, SIGNAL(image_grabbed(quint64, QString)), this, SLOT(camera_image_grabbed(quint64, QString)));
+  connect(sony_cam, SIGNAL(idle()), this, SLOT(camera_idle()));
+  cameras.append(sony_cam);
+  return cameras.size() - 1;
+}
+
+// Maximum number of requests in flight for every camera
+void CameraFleet::set_max_in_flight(const int _max_in_flight) {
+  if (_max_in_flight < 1) {
+    std::cout << "At least one request has to be in flight !!! Keeping the previous value !!!" << std::endl;
+    return;
+  }
+  max_in_flight = _max_in_flight;
+  for (int i = 0; i < cameras.size(); ++i)
+    cameras.at(i)->set_max_in_flight(max_in_flight);
+}
+
+// Number of requests queued or in flight over the fleet
+int CameraFleet::get_pending_requests() const {
+  int pending = 0;
+  for (int i = 0; i < cameras.size(); ++i)
+    pending += cameras.at(i)->get_pending_requests();
+  return pending;
+}
+
+// Block the caller until every camera is idle
+void CameraFleet::wait_for_idle() {
+  if (get_pending_requests() == 0)
+    return;
+  QEventLoop loop;
+  connect(this, SIGNAL(idle()), &loop, SLOT(quit()));
+  loop.exec();
+}
+
+// Spherical acquisition on all the cameras at once
+void CameraFleet::spherical_acquisition(const long step_pan, const long step_tilt, const long speed, const QString& _zoom, const QString& _focus, const QString& _directory_storage) {
+  start_work();
+  for (int i = 0; i < cameras.size(); ++i)
+    cameras.at(i)->spherical_acquisition(step_pan, step_tilt, speed, _zoom, _focus, camera_directory(_directory_storage, cameras.at(i)));
+}
+
+// Coverage acquisition on all the cameras at once
+void CameraFleet::coverage_acquisition(const double _overlap, const long speed, const QString& _zoom, const QString& _focus, const QString& _directory_storage) {
+  start_work();
+  for (int i = 0; i < cameras.size(); ++i)
+    cameras.at(i)->coverage_acquisition(_overlap, speed, _zoom, _focus, camera_directory(_directory_storage, cameras.at(i)));
+}
+
+// Grab an image on every camera
+void CameraFleet::grab_images() {
+  start_work();
+  for (int i = 0; i < cameras.size(); ++i)
+    cameras.at(i)->grab_image();
+}
+
+// Directory of a camera inside the directory of the fleet
+QString CameraFleet::camera_directory(const QString& _directory_storage, const SonySNCRX550N* _camera) const {
+  QString directory = _directory_storage;
+  if (!directory.endsWith("/"))
+    directory += "/";
+  return directory + _camera->get_ip_address() + "/";
+}
+
+// Total bytes written by the cameras
+quint64 CameraFleet::bytes_written() const {
+  quint64 bytes = 0;
+  for (int i = 0; i < cameras.size(); ++i)
+    bytes += cameras.at(i)->get_frame_writer()->get_bytes_written();
+  return bytes;
+}
+
+// Start to account for a new work, a work already running goes on
+void CameraFleet::start_work() {
+  if (working)
+    return;
+  working = true;
+  images_grabbed = 0;
+  bytes_at_start = bytes_written();
+  work_timer.start();
+  if (report_interval > 0)
+    report_timer.start(report_interval);
+}
+
+// Aggregate throughput since the start of the running work
+FleetThroughput CameraFleet::get_throughput() const {
+  FleetThroughput result;
+  result.images = images_grabbed;
+  result.bytes = bytes_written() - bytes_at_start;
+  result.elapsed = work_timer.isValid() ? work_timer.elapsed() / 1000.0 : 0.0;
+  result.images_per_second = (result.elapsed > 0.0) ? result.images / result.elapsed : 0.0;
+  result.megabytes_per_second = (result.elapsed > 0.0) ? result.bytes / (1024.0 * 1024.0) / result.elapsed : 0.0;
+  return result;
+}
+
+// slot to count the images of the cameras
+void CameraFleet::camera_image_grabbed(const quint64 _request_id, const QString& _filename) {
+  Q_UNUSED(_request_id);
+  Q_UNUSED(_filename);
+  ++images_grabbed;
+}
+
+// slot to report the end of the work once every camera is idle
+void CameraFleet::camera_idle() {
+  if (get_pending_requests() != 0)
+    return;
+  if (working) {
+    report_timer.stop();
+    report_throughput();
+    working = false;
+  }
+  emit idle();
+}
+
+// slot to print the throughput
+void CameraFleet::report_throughput() {
+  const FleetThroughput current = get_throughput();
+  std::cout << "Fleet of " << cameras.size() << " cameras - " << current.images << " images in " << current.elapsed << " s - " << current.images_per_second << " images/s - " << current.megabytes_per_second << " MB/s" << std::endl;
+  emit throughput(current.images_per_second, current.megabytes_per_second);
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef CAMERAFLEET_H_
+#define CAMERAFLEET_H_
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QNetworkAccessManager>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "sonysncrx550n.h"
+
+// Throughput of the fleet since the start of the running work
+struct FleetThroughput {
+  quint64 images;
+  quint64 bytes;
+  double elapsed;
+  double images_per_second;
+  double megabytes_per_second;
+};
+
+class CameraFleet : public QObject
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - the cameras share a single network stack and event loop,
+  // each one queueing its own requests so that they run concurrently
+  explicit CameraFleet(QObject *parent = 0);
+  // Destructor - the cameras go before the network stack they share
+  ~CameraFleet();
+
+  /* Camera management */
+  // Add a camera and return its index - see SonySNCRX550N::StartupMode
+  int add_camera(const QString& _ip_address, const SonySNCRX550N::StartupMode _startup = SonySNCRX550N::home_startup);
+  inline int size() const { return cameras.size(); }
+  inline SonySNCRX550N* camera(const int _index) { return cameras.at(_index); }
+  // Maximum number of requests in flight for every camera - see
+  // SonySNCRX550N::set_max_in_flight() to set the limit of a single camera
+  void set_max_in_flight(const int _max_in_flight);
+  // Number of requests queued or in flight over the fleet
+  int get_pending_requests() const;
+  // Block the caller until every camera is idle
+  void wait_for_idle();
+
+  /* Fleet work */
+  // Acquisitions run on all the cameras at once, the images of each camera
+  // are stored in <directory>/<ip address>/
+  void spherical_acquisition(const long step_pan = 18, const long step_tilt = 8, const long speed = 24, const QString& _zoom = "oz-1", const QString& _focus = "f-inf", const QString& _directory_storage = "./");
+  void coverage_acquisition(const double _overlap = 20.0, const long speed = 24, const QString& _zoom = "oz-1", const QString& _focus = "f-inf", const QString& _directory_storage = "./");
+  // Grab an image on every camera
+  void grab_images();
+
+  /* Throughput */
+  // Aggregate throughput since the start of the running work
+  FleetThroughput get_throughput() const;
+  // Print and emit the throughput every _interval ms while working, 0 to
+  // report at the end only
+  inline void set_report_interval(const int _interval) { report_interval = _interval; }
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  QNetworkAccessManager net_acc_manager;
+  QList<SonySNCRX550N*> cameras;
+  int max_in_flight;
+
+  // Private members regarding the throughput
+  bool working;
+  QElapsedTimer work_timer;
+  quint64 images_grabbed;
+  // Bytes already written by the cameras when the work started
+  quint64 bytes_at_start;
+  int report_interval;
+  QTimer report_timer;
+
+  // Directory of a camera inside the directory of the fleet
+  QString camera_directory(const QString& _directory_storage, const SonySNCRX550N* _camera) const;
+  // Total bytes written by the cameras
+  quint64 bytes_written() const;
+  // Start to account for a new work
+  void start_work();
+
+private slots:
+  // slot to count the images of the cameras
+  void camera_image_grabbed(const quint64 _request_id, const QString& _filename);
+  // slot to report the end of the work once every camera is idle
+  void camera_idle();
+  // slot to print the throughput periodically
+  void report_throughput();
+
+signals:
+  // Emitted periodically and at the end of the work
+  void throughput(const double _images_per_second, const double _megabytes_per_second);
+  // Emitted when no camera has requests queued or in flight anymore
+  void idle();
+};
+
+#endif  // CAMERAFLEET_H_
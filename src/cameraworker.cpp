@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "cameraworker.h"
+
+// qt library
+#include <QMetaObject>
+#include <QMetaType>
+
+WorkerCommandQueue::WorkerCommandQueue() : head(&stub), tail(&stub), wake_pending(false) {
+  stub.next.store(0);
+}
+
+// The commands left are deleted
+WorkerCommandQueue::~WorkerCommandQueue() {
+  while (WorkerCommand* command = pop())
+    delete command;
+}
+
+// Swap the head, then link the previous one - until the link is done the
+// consumer sees the queue as ending before this command
+void WorkerCommandQueue::link(WorkerCommand* _command) {
+  _command->next.store(0, std::memory_order_relaxed);
+  WorkerCommand* previous = head.exchange(_command, std::memory_order_acq_rel);
+  previous->next.store(_command, std::memory_order_release);
+}
+
+// Push a command, from any thread
+bool WorkerCommandQueue::push(WorkerCommand* _command) {
+  link(_command);
+  return !wake_pending.exchange(true);
+}
+
+// Pop the oldest command, from the consumer thread only
+WorkerCommand* WorkerCommandQueue::pop() {
+  WorkerCommand* oldest = tail;
+  WorkerCommand* next = oldest->next.load(std::memory_order_acquire);
+  // Skip the stub
+  if (oldest == &stub) {
+    if (next == 0)
+      return 0;
+    tail = next;
+    oldest = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+  if (next != 0) {
+    tail = next;
+    return oldest;
+  }
+  // A producer swapped the head but did not link it yet
+  if (oldest != head.load(std::memory_order_acquire))
+    return 0;
+  // Last command - the stub takes its place at the end
+  link(&stub);
+  next = oldest->next.load(std::memory_order_acquire);
+  if (next != 0) {
+    tail = next;
+    return oldest;
+  }
+  return 0;
+}
+
+WorkerCommandRunner::WorkerCommandRunner(SonySNCRX550N* _camera, WorkerCommandQueue* _queue, std::atomic<quint64>* _coalesced, QObject *parent) :
+  QObject(parent), camera(_camera), queue(_queue), coalesced(_coalesced) {
+  connect(camera, SIGNAL(request_finished(quint64, bool)), this, SLOT(request_finished(quint64, bool)));
+}
+
+// slot to take the commands posted since the last call
+void WorkerCommandRunner::drain() {
+  queue->begin_drain();
+  while (WorkerCommand* command = queue->pop()) {
+    PendingCommand pending;
+    pending.kind = command->kind;
+    pending.command = command->command;
+    pending.results.append(command->result);
+    backlog.append(pending);
+    delete command;
+  }
+  coalesce();
+  submit_backlog();
+}
+
+// Merge each absolute move into the move following it - nothing is taken in
+// between, so the camera ends up in the same pose. A relative motion, an
+// image or a settle barrier keeps the moves around it apart.
+void WorkerCommandRunner::coalesce() {
+  for (int i = 0; i + 1 < backlog.size(); ) {
+    PendingCommand& later = backlog[i + 1];
+    const PendingCommand& earlier = backlog.at(i);
+    if ((earlier.kind != WorkerCommand::move_command) || (later.kind != WorkerCommand::move_command) || earlier.command.relative || later.command.relative) {
+      ++i;
+      continue;
+    }
+    // The axes the later move leaves alone keep the earlier target
+    const PtzCommand& first = earlier.command;
+    PtzCommand& merged = later.command;
+    if ((first.axes & PtzCommand::pan_tilt_axis) && (!(merged.axes & PtzCommand::pan_tilt_axis))) {
+      merged.pose.pan_steps = first.pose.pan_steps;
+      merged.pose.tilt_steps = first.pose.tilt_steps;
+      merged.speed = first.speed;
+    }
+    if ((first.axes & PtzCommand::zoom_axis) && (!(merged.axes & PtzCommand::zoom_axis)))
+      merged.pose.zoom_code = first.pose.zoom_code;
+    if ((first.axes & PtzCommand::focus_axis) && (!(merged.axes & PtzCommand::focus_axis)))
+      merged.pose.focus_code = first.pose.focus_code;
+    merged.axes |= first.axes;
+    QList<QFutureInterface<bool> > results = earlier.results;
+    results.append(later.results);
+    later.results = results;
+    backlog.removeAt(i);
+    ++(*coalesced);
+  }
+}
+
+// Hand the commands over to the camera while it is not busy, the moves held
+// back can still be merged
+void WorkerCommandRunner::submit_backlog() {
+  while ((!backlog.isEmpty()) && (camera->get_pending_requests() < max_pending_requests)) {
+    PendingCommand pending = backlog.takeFirst();
+    quint64 request_id = 0;
+    if (pending.kind == WorkerCommand::move_command)
+      request_id = camera->command(pending.command);
+    else if (pending.kind == WorkerCommand::image_command)
+      request_id = camera->grab_image();
+    else
+      request_id = camera->wait_for_settle();
+    if (request_id == 0)
+      report(pending.results, false);
+    else
+      submitted.insert(request_id, pending.results);
+  }
+}
+
+// slot to report the futures of a request
+void WorkerCommandRunner::request_finished(const quint64 _request_id, const bool _success) {
+  auto it = submitted.find(_request_id);
+  if (it != submitted.end()) {
+    report(it.value(), _success);
+    submitted.erase(it);
+  }
+  submit_backlog();
+}
+
+// slot to stop the event loop of the worker thread
+void WorkerCommandRunner::stop() {
+  fail_all();
+  thread()->quit();
+}
+
+// Fail the commands not answered yet
+void WorkerCommandRunner::fail_all() {
+  drain();
+  for (int i = 0; i < backlog.size(); ++i)
+    report(backlog[i].results, false);
+  backlog.clear();
+  for (auto it = submitted.begin(); it != submitted.end(); ++it)
+    report(it.value(), false);
+  submitted.clear();
+}
+
+void WorkerCommandRunner::report(QList<QFutureInterface<bool> >& _results, const bool _success) {
+  for (int i = 0; i < _results.size(); ++i) {
+    _results[i].reportResult(_success);
+    _results[i].reportFinished();
+  }
+}
+
+// The camera is created on the worker thread
+CameraWorker::CameraWorker(const QString& _ip_address, const SonySNCRX550N::StartupMode _startup) :
+  ip_address(_ip_address), startup(_startup), coalesced(0), camera(0), runner(0) {
+  // The signals are delivered across threads
+  qRegisterMetaType<quint64>("quint64");
+  thread = new WorkerThread(this);
+  thread->start();
+  ready.acquire();
+}
+
+// The commands not answered yet fail
+CameraWorker::~CameraWorker() {
+  // Queued to the runner, the loop may not have started yet
+  QMetaObject::invokeMethod(runner.load(), "stop", Qt::QueuedConnection);
+  thread->wait();
+  delete thread;
+  // Commands posted while the thread was stopping
+  while (WorkerCommand* command = queue.pop()) {
+    command->result.reportResult(false);
+    command->result.reportFinished();
+    delete command;
+  }
+}
+
+// Body of the worker thread
+void CameraWorker::run_camera() {
+  SonySNCRX550N* thread_camera = new SonySNCRX550N(ip_address, 0, 0, startup);
+  WorkerCommandRunner* thread_runner = new WorkerCommandRunner(thread_camera, &queue, &coalesced);
+  camera = thread_camera;
+  runner = thread_runner;
+  ready.release();
+  thread->run_loop();
+  // The requests in flight are dropped with the camera
+  thread_runner->fail_all();
+  runner.store(0);
+  camera = 0;
+  delete thread_runner;
+  delete thread_camera;
+}
+
+// Post a command, or fail it at once when it could not be built
+QFuture<bool> CameraWorker::post(const WorkerCommand::Kind _kind, const PtzCommand& _command, const bool _valid) {
+  WorkerCommand* command = new WorkerCommand;
+  command->kind = _kind;
+  command->command = _command;
+  command->result.reportStarted();
+  QFuture<bool> future = command->result.future();
+  if (!_valid) {
+    command->result.reportResult(false);
+    command->result.reportFinished();
+    delete command;
+    return future;
+  }
+  // Without runner the thread is stopping, the destructor fails the command
+  WorkerCommandRunner* current_runner = runner.load();
+  if (queue.push(command) && (current_runner != 0))
+    QMetaObject::invokeMethod(current_runner, "drain", Qt::QueuedConnection);
+  return future;
+}
+
+QFuture<bool> CameraWorker::relative_motion(const long _p_angle, const long _t_angle, const long _speed) {
+  PtzCommand command;
+  const bool valid = SonySNCRX550N::make_relative_motion(_p_angle, _t_angle, _speed, command);
+  return post(WorkerCommand::move_command, command, valid);
+}
+
+QFuture<bool> CameraWorker::absolute_motion(const double _p_angle, const double _t_angle, const long _speed) {
+  PtzCommand command;
+  const bool valid = SonySNCRX550N::make_absolute_motion(_p_angle, _t_angle, _speed, command);
+  return post(WorkerCommand::move_command, command, valid);
+}
+
+QFuture<bool> CameraWorker::absolute_pose(const double _p_angle, const double _t_angle, const QString& _zoom_position, const QString& _focus_position, const long _speed) {
+  PtzCommand command;
+  const bool valid = SonySNCRX550N::make_absolute_pose(_p_angle, _t_angle, _zoom_position, _focus_position, _speed, command);
+  return post(WorkerCommand::move_command, command, valid);
+}
+
+QFuture<bool> CameraWorker::absolute_zoom(const QString& _zoom_position) {
+  PtzCommand command;
+  const bool valid = SonySNCRX550N::make_absolute_zoom(_zoom_position, command);
+  return post(WorkerCommand::move_command, command, valid);
+}
+
+QFuture<bool> CameraWorker::absolute_focus(const QString& _focus_position) {
+  PtzCommand command;
+  const bool valid = SonySNCRX550N::make_absolute_focus(_focus_position, command);
+  return post(WorkerCommand::move_command, command, valid);
+}
+
+QFuture<bool> CameraWorker::grab_image() {
+  return post(WorkerCommand::image_command, PtzCommand());
+}
+
+QFuture<bool> CameraWorker::wait_for_settle() {
+  return post(WorkerCommand::settle_command, PtzCommand());
+}
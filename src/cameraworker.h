@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef CAMERAWORKER_H_
+#define CAMERAWORKER_H_
+
+// stl library
+#include <atomic>
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QThread>
+#include <QSemaphore>
+#include <QFuture>
+#include <QFutureInterface>
+
+#include "ptzcodec.h"
+#include "sonysncrx550n.h"
+
+// Command posted to the worker thread, the future is reported once the camera
+// answered it
+struct WorkerCommand {
+  enum Kind { move_command, image_command, settle_command };
+  Kind kind;
+  PtzCommand command;
+  QFutureInterface<bool> result;
+  // Link of the command queue
+  std::atomic<WorkerCommand*> next;
+};
+
+// Lock-free queue with many producers and a single consumer - intrusive list
+// where the producers swap the head and the consumer walks from the tail
+class WorkerCommandQueue
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  WorkerCommandQueue();
+  // Destructor - the commands left are deleted
+  ~WorkerCommandQueue();
+
+  // Push a command, from any thread. Returns true when the consumer has to
+  // be woken up, i.e. it was not already.
+  bool push(WorkerCommand* _command);
+  // Pop the oldest command, from the consumer thread only. Returns 0 when
+  // empty, or when a producer is halfway through a push - it wakes the
+  // consumer up once done.
+  WorkerCommand* pop();
+  // The consumer starts draining, the next push wakes it up again
+  inline void begin_drain() { wake_pending.store(false); }
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  std::atomic<WorkerCommand*> head;
+  WorkerCommand* tail;
+  WorkerCommand stub;
+  std::atomic<bool> wake_pending;
+
+  void link(WorkerCommand* _command);
+
+  WorkerCommandQueue(const WorkerCommandQueue&);
+  WorkerCommandQueue& operator=(const WorkerCommandQueue&);
+};
+
+// Feed the camera from the command queue, on the worker thread. The moves
+// waiting for the camera are merged, only the latest target is sent.
+class WorkerCommandRunner : public QObject
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  explicit WorkerCommandRunner(SonySNCRX550N* _camera, WorkerCommandQueue* _queue, std::atomic<quint64>* _coalesced, QObject *parent = 0);
+
+  // Fail the commands not answered yet
+  void fail_all();
+
+public slots:
+  // slot to take the commands posted since the last call
+  void drain();
+  // slot to stop the event loop of the worker thread
+  void stop();
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  SonySNCRX550N* camera;
+  WorkerCommandQueue* queue;
+  std::atomic<quint64>* coalesced;
+
+  // Command waiting for the camera, with the futures of the commands merged
+  // into it
+  struct PendingCommand {
+    WorkerCommand::Kind kind;
+    PtzCommand command;
+    QList<QFutureInterface<bool> > results;
+  };
+  QList<PendingCommand> backlog;
+  // Futures of the requests sent to the camera
+  QHash<quint64, QList<QFutureInterface<bool> > > submitted;
+  // Requests queued in the camera before the next command is held back
+  static const int max_pending_requests = 2;
+
+  // Merge a move into the move following it
+  void coalesce();
+  // Hand the commands over to the camera while it is not busy
+  void submit_backlog();
+  static void report(QList<QFutureInterface<bool> >& _results, const bool _success);
+
+private slots:
+  // slot to report the futures of a request
+  void request_finished(const quint64 _request_id, const bool _success);
+};
+
+// Camera running on its own thread - the commands can be posted from any
+// thread and return immediately with a future of the answer of the camera.
+// When the commands are posted faster than the camera moves, the successive
+// motions are merged and their futures report the merged command.
+class CameraWorker
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - the camera is created on the worker thread, see
+  // SonySNCRX550N::StartupMode
+  explicit CameraWorker(const QString& _ip_address, const SonySNCRX550N::StartupMode _startup = SonySNCRX550N::home_startup);
+  // Destructor - the commands not answered yet fail. No command may be posted
+  // once the destruction started.
+  ~CameraWorker();
+
+  /* Thread safe commands - see SonySNCRX550N for the ranges */
+  QFuture<bool> relative_motion(const long _p_angle = 0, const long _t_angle = 0, const long _speed = 24);
+  QFuture<bool> absolute_motion(const double _p_angle = 0, const double _t_angle = 0, const long _speed = 24);
+  QFuture<bool> absolute_pose(const double _p_angle = 0, const double _t_angle = 0, const QString& _zoom_position = "oz-1", const QString& _focus_position = "f-inf", const long _speed = 24);
+  QFuture<bool> absolute_zoom(const QString& _zoom_position = "oz-1");
+  QFuture<bool> absolute_focus(const QString& _focus_position = "f-inf");
+  QFuture<bool> grab_image();
+  QFuture<bool> wait_for_settle();
+
+  // Camera driven by the worker - not thread safe apart from its metrics,
+  // to be used from the worker thread only
+  inline SonySNCRX550N* get_camera() { return camera; }
+  inline QThread* get_thread() { return thread; }
+  // Number of commands merged into a later one
+  inline quint64 get_coalesced_commands() const { return coalesced.load(); }
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  // Thread running the event loop of the camera
+  class WorkerThread : public QThread
+  {
+  public:
+    explicit WorkerThread(CameraWorker* _worker) : worker(_worker) {}
+    inline int run_loop() { return exec(); }
+  protected:
+    void run() { worker->run_camera(); }
+  private:
+    CameraWorker* worker;
+  };
+
+  QString ip_address;
+  SonySNCRX550N::StartupMode startup;
+  WorkerThread* thread;
+  WorkerCommandQueue queue;
+  std::atomic<quint64> coalesced;
+  // Created and destroyed on the worker thread - the runner is read by the
+  // threads posting the commands, 0 once the worker thread is stopping
+  SonySNCRX550N* camera;
+  std::atomic<WorkerCommandRunner*> runner;
+  // Released once the camera is created
+  QSemaphore ready;
+
+  // Body of the worker thread
+  void run_camera();
+  // Post a command, or fail it at once when it could not be built
+  QFuture<bool> post(const WorkerCommand::Kind _kind, const PtzCommand& _command, const bool _valid = true);
+
+  CameraWorker(const CameraWorker&);
+  CameraWorker& operator=(const CameraWorker&);
+};
+
+#endif  // CAMERAWORKER_H_
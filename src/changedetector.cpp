@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "changedetector.h"
+
+// qt library
+#include <QBuffer>
+#include <QImage>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QSize>
+
+// stl library
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+ChangeDetector::ChangeDetector() :
+  threshold(default_threshold), frames_compared(0), frames_unchanged(0), bytes_skipped(0) {
+}
+
+// Compare a JPEG frame with the reference of its pose
+bool ChangeDetector::is_changed(const QString& _target, const quint64 _pose_key, const QByteArray& _jpeg, QByteArray& _thumbnail) {
+  // Decode out of the lock, this is the expensive part
+  _thumbnail.clear();
+  QByteArray thumbnail;
+  if (!make_thumbnail(_jpeg, thumbnail))
+    return true;
+  ++frames_compared;
+  QMutexLocker locker(&mutex);
+  const QByteArray reference = references.value(_target).value(_pose_key);
+  locker.unlock();
+  if (!reference.isEmpty()) {
+    const quint32 sum = difference(reinterpret_cast<const quint8*> (reference.constData()), reinterpret_cast<const quint8*> (thumbnail.constData()), thumbnail_size);
+    if (static_cast<double> (sum) <= threshold.load() * thumbnail_size) {
+      ++frames_unchanged;
+      bytes_skipped += static_cast<quint64> (_jpeg.size());
+      return false;
+    }
+  }
+  _thumbnail = thumbnail;
+  return true;
+}
+
+// Make a thumbnail the reference of its pose
+void ChangeDetector::commit(const QString& _target, const quint64 _pose_key, const QByteArray& _thumbnail) {
+  if (_thumbnail.isEmpty())
+    return;
+  QMutexLocker locker(&mutex);
+  references[_target].insert(_pose_key, _thumbnail);
+}
+
+// Forget the references
+void ChangeDetector::clear() {
+  QMutexLocker locker(&mutex);
+  references.clear();
+}
+
+// Sum of the absolute differences of two thumbnails - 16 pixels at a time
+// with SSE2, a size multiple of 16 is assumed
+quint32 ChangeDetector::difference(const quint8* _first, const quint8* _second, const int _size) {
+  quint32 sum = 0;
+  int i = 0;
+#ifdef __SSE2__
+  __m128i total = _mm_setzero_si128();
+  for (; i + 16 <= _size; i += 16) {
+    const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*> (_first + i));
+    const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*> (_second + i));
+    // Two partial sums, in the low 16 bits of each half
+    total = _mm_add_epi64(total, _mm_sad_epu8(first, second));
+  }
+  sum = static_cast<quint32> (_mm_cvtsi128_si32(total)) + static_cast<quint32> (_mm_cvtsi128_si32(_mm_srli_si128(total, 8)));
+#endif
+  for (; i < _size; ++i)
+    sum += (_first[i] > _second[i]) ? (_first[i] - _second[i]) : (_second[i] - _first[i]);
+  return sum;
+}
+
+// Decode the luma thumbnail of a JPEG frame - the reader scales the image
+// down while decoding, which is much cheaper than decoding it in full
+bool ChangeDetector::make_thumbnail(const QByteArray& _jpeg, QByteArray& _thumbnail) {
+  QBuffer buffer;
+  buffer.setData(_jpeg);
+  if (!buffer.open(QIODevice::ReadOnly))
+    return false;
+  QImageReader reader(&buffer, "jpeg");
+  reader.setScaledSize(QSize(thumbnail_width, thumbnail_height));
+  QImage image = reader.read();
+  if (image.isNull())
+    return false;
+  if ((image.width() != thumbnail_width) || (image.height() != thumbnail_height))
+    image = image.scaled(thumbnail_width, thumbnail_height);
+  if (image.format() != QImage::Format_RGB32)
+    image = image.convertToFormat(QImage::Format_RGB32);
+  _thumbnail.resize(thumbnail_size);
+  quint8* luma = reinterpret_cast<quint8*> (_thumbnail.data());
+  for (int y = 0; y < thumbnail_height; ++y) {
+    const quint32* line = reinterpret_cast<const quint32*> (image.constScanLine(y));
+    for (int x = 0; x < thumbnail_width; ++x) {
+      // Same weights as qGray()
+      const quint32 pixel = line[x];
+      *luma++ = static_cast<quint8> ((((pixel >> 16) & 0xFF) * 11 + ((pixel >> 8) & 0xFF) * 16 + (pixel & 0xFF) * 5) / 32);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef CHANGEDETECTOR_H_
+#define CHANGEDETECTOR_H_
+
+// stl library
+#include <atomic>
+
+// qt library
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+// Tell whether the frame taken at a pose differs from the previous frame
+// stored at that pose. Each pose of each storage target - directory or
+// archive - keeps a thumbnail of reference, in luma, compared with the
+// thumbnail of the new frame through the mean absolute difference of their
+// pixels. The reference is only replaced by a frame over the threshold, once
+// that frame is stored, so that a slow drift ends up being stored as well.
+// The detector can be used from any thread.
+class ChangeDetector
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Size of the thumbnails
+  static const int thumbnail_width = 64;
+  static const int thumbnail_height = 48;
+  static const int thumbnail_size = thumbnail_width * thumbnail_height;
+
+  ChangeDetector();
+
+  // Mean absolute difference of the luma, from 0 to 255, over which a frame
+  // is considered as changed
+  inline void set_threshold(const double _threshold) { threshold = _threshold; }
+  inline double get_threshold() const { return threshold.load(); }
+
+  // Compare a JPEG frame with the reference of its pose in _target - a frame
+  // without reference or which cannot be decoded is changed. The key has to
+  // be the same at each visit, i.e. the one of the pose commanded, not read.
+  // The thumbnail of a changed frame is given back in _thumbnail, empty when
+  // the frame cannot be decoded.
+  bool is_changed(const QString& _target, const quint64 _pose_key, const QByteArray& _jpeg, QByteArray& _thumbnail);
+  // Make a thumbnail the reference of its pose, once its frame is stored
+  void commit(const QString& _target, const quint64 _pose_key, const QByteArray& _thumbnail);
+  // Forget the references, the next frame of every pose is changed
+  void clear();
+
+  /* Counters */
+  inline quint64 get_frames_compared() const { return frames_compared.load(); }
+  inline quint64 get_frames_unchanged() const { return frames_unchanged.load(); }
+  inline quint64 get_bytes_skipped() const { return bytes_skipped.load(); }
+
+  // Sum of the absolute differences of two thumbnails
+  static quint32 difference(const quint8* _first, const quint8* _second, const int _size);
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  std::atomic<double> threshold;
+  static constexpr double default_threshold = 6.0;
+  // References of the poses by storage target, protected by the mutex
+  QMutex mutex;
+  QHash<QString, QHash<quint64, QByteArray> > references;
+
+  // Private counters
+  std::atomic<quint64> frames_compared;
+  std::atomic<quint64> frames_unchanged;
+  std::atomic<quint64> bytes_skipped;
+
+  // Decode the luma thumbnail of a JPEG frame
+  static bool make_thumbnail(const QByteArray& _jpeg, QByteArray& _thumbnail);
+
+  ChangeDetector(const ChangeDetector&);
+  ChangeDetector& operator=(const ChangeDetector&);
+};
+
+#endif  // CHANGEDETECTOR_H_
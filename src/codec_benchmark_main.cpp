@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QUrl>
+
+#include "ptzcodec.h"
+
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+
+// Encoding of the commands before PtzCodec - the angles went through
+// QString::number(..., 16) and the zoom and focus through std::map
+static const std::map< QString, QString > legacy_zoom_key_to_hex = { {"oz-1", "0000"}, {"oz-2", "1760"}, {"oz-3", "214C"}, {"oz-4", "2722"}, {"oz-5", "2B22"}, {"oz-6", "2E20"}, {"oz-7", "3080"}, {"oz-8", "3278"}, {"oz-9", "3426"}, {"oz-10", "359E"} };
+static const std::map< QString, QString > legacy_focus_key_to_hex = { {"f-inf", "1000"}, {"f-7200", "2000"}, {"f-3300", "3000"}, {"f-2000", "4000"}, {"f-1300", "5000"}, {"f-1000", "6000"} };
+
+static QString legacy_to_hex(const double _angle, const double _steps, const double _range) {
+  QString tmp = QString::number(static_cast<long> (std::round(_angle * _steps / _range)), 16).toUpper();
+  if (tmp.length() > 4)
+    return tmp.mid(tmp.length() - 4, 4);
+  else
+    return tmp;
+}
+
+static double legacy_to_deg(const QString _hexa, const double _steps, const double _range) {
+  short int dec_steps = std::stoul(_hexa.toStdString(), nullptr, 16);
+  return (static_cast<double> (dec_steps) * _range / _steps);
+}
+
+static QUrl legacy_absolute_pose(const QUrl& _base, const double _pan, const double _tilt, const QString& _zoom, const QString& _focus, const long _speed) {
+  auto hexa_zoom = legacy_zoom_key_to_hex.find(_zoom);
+  auto hexa_focus = legacy_focus_key_to_hex.find(_focus);
+  QString query = legacy_to_hex(_pan, 16320.0, 360.0) + "," + legacy_to_hex(_tilt, 4352.0, 96.0) + "," + QString::number(_speed);
+  QUrl url(_base);
+  url.addQueryItem("absolutepantilt", query);
+  url.addQueryItem("absolutezoom", hexa_zoom->second);
+  url.addQueryItem("absolutefocus", hexa_focus->second);
+  return url;
+}
+
+// Time per iteration of a run, in ns
+static void print_run(const char* _name, const qint64 _elapsed, const int _iterations) {
+  std::cout << _name << ": " << static_cast<double> (_elapsed) / _iterations << " ns per command" << std::endl;
+}
+
+// Usage: codec_benchmark [<iterations>]
+// Encodes and decodes the same sweep of poses through the previous QString
+// path and through PtzCodec.
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+
+  const int iterations = (argc > 1) ? QString(argv[1]).toInt() : 200000;
+  if (iterations < 1) {
+    std::cout << "The number of iterations has to be positive !!!" << std::endl;
+    return 1;
+  }
+  const QUrl base("http://127.0.0.1/command/ptzf.cgi?");
+  const QString zooms[] = { "oz-1", "oz-3", "oz-10" };
+  const QString focuses[] = { "f-inf", "f-2000", "f-1000" };
+  QElapsedTimer timer;
+  // Keep the results alive
+  qint64 checksum = 0;
+
+  /* Query of a pose */
+  timer.start();
+  for (int i = 0; i < iterations; ++i) {
+    const double pan = -180.0 + (i % 3600) * 0.1;
+    const double tilt = -48.0 + (i % 960) * 0.1;
+    const QString query = legacy_to_hex(pan, 16320.0, 360.0) + "," + legacy_to_hex(tilt, 4352.0, 96.0) + "," + QString::number(24) + "&absolutezoom=" +
+      legacy_zoom_key_to_hex.find(zooms[i % 3])->second + "&absolutefocus=" + legacy_focus_key_to_hex.find(focuses[i % 3])->second;
+    checksum += query.size();
+  }
+  print_run("query - QString", timer.nsecsElapsed(), iterations);
+
+  PtzQueryEncoder encoder;
+  timer.start();
+  for (int i = 0; i < iterations; ++i) {
+    PtzCommand pose;
+    pose.axes = PtzCommand::pan_tilt_axis | PtzCommand::zoom_axis | PtzCommand::focus_axis;
+    pose.pose.pan_steps = PtzCodec::pan_to_steps(-180.0 + (i % 3600) * 0.1);
+    pose.pose.tilt_steps = PtzCodec::tilt_to_steps(-48.0 + (i % 960) * 0.1);
+    pose.pose.zoom_code = PtzCodec::zoom_code(zooms[i % 3]);
+    pose.pose.focus_code = PtzCodec::focus_code(focuses[i % 3]);
+    pose.speed = 24;
+    encoder.encode(pose);
+    checksum += encoder.size();
+  }
+  print_run("query - PtzQueryEncoder", timer.nsecsElapsed(), iterations);
+
+  /* Url of a pose, as sent to the network access manager */
+  timer.start();
+  for (int i = 0; i < iterations; ++i) {
+    const QUrl url = legacy_absolute_pose(base, -180.0 + (i % 3600) * 0.1, -48.0 + (i % 960) * 0.1, zooms[i % 3], focuses[i % 3], 24);
+    checksum += url.isValid() ? 1 : 0;
+  }
+  print_run("url - QUrl::addQueryItem", timer.nsecsElapsed(), iterations);
+
+  timer.start();
+  for (int i = 0; i < iterations; ++i) {
+    PtzCommand pose;
+    pose.axes = PtzCommand::pan_tilt_axis | PtzCommand::zoom_axis | PtzCommand::focus_axis;
+    pose.pose.pan_steps = PtzCodec::pan_to_steps(-180.0 + (i % 3600) * 0.1);
+    pose.pose.tilt_steps = PtzCodec::tilt_to_steps(-48.0 + (i % 960) * 0.1);
+    pose.pose.zoom_code = PtzCodec::zoom_code(zooms[i % 3]);
+    pose.pose.focus_code = PtzCodec::focus_code(focuses[i % 3]);
+    pose.speed = 24;
+    encoder.encode(pose);
+    QUrl url(base);
+    url.setEncodedQuery(encoder.to_byte_array());
+    checksum += url.isValid() ? 1 : 0;
+  }
+  print_run("url - PtzQueryEncoder", timer.nsecsElapsed(), iterations);
+
+  /* Decoding of the answers */
+  const QString answers[] = { "E1E5", "F808", "1FE0", "0110" };
+  timer.start();
+  double angle = 0;
+  for (int i = 0; i < iterations; ++i)
+    angle += legacy_to_deg(answers[i % 4], 16320.0, 360.0);
+  print_run("decode - std::stoul", timer.nsecsElapsed(), iterations);
+
+  timer.start();
+  for (int i = 0; i < iterations; ++i) {
+    quint16 code = 0;
+    if (PtzCodec::parse_code(answers[i % 4], code))
+      angle += PtzCodec::steps_to_pan(PtzCodec::code_to_steps(code));
+  }
+  print_run("decode - PtzCodec", timer.nsecsElapsed(), iterations);
+
+  std::cout << "checksum " << checksum << " " << angle << std::endl;
+  return 0;
+}
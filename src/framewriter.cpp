@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "framewriter.h"
+
+// qt library
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaType>
+#include <QMutexLocker>
+
+// stl library
+#include <iostream>
+#include <unistd.h>
+
+FrameWriter::FrameWriter(const int _thread_count, QObject *parent) :
+  QObject(parent), busy_threads(0), stopping(false),
+  max_queued_bytes(default_max_queued_bytes), saturated(false),
+  fsync_policy(fsync_never), fsync_period(16), fsync_tickets(0),
+  queued_bytes(0), frames_written(0), bytes_written(0), write_errors(0),
+  total_write_latency(0), max_write_latency(0), latency_histogram(0), change_detector(0) {
+  // The signals are delivered across threads
+  qRegisterMetaType<quint64>("quint64");
+  // Start the writer threads
+  const int thread_count = (_thread_count < 1) ? 1 : _thread_count;
+  for (int i = 0; i < thread_count; ++i) {
+    WriterThread* thread = new WriterThread(this);
+    threads.append(thread);
+    thread->start();
+  }
+}
+
+// The queued frames are written before the threads stop
+FrameWriter::~FrameWriter() {
+  {
+    QMutexLocker locker(&mutex);
+    stopping = true;
+    job_available.wakeAll();
+  }
+  for (int i = 0; i < threads.size(); ++i) {
+    threads.at(i)->wait();
+    delete threads.at(i);
+  }
+}
+
+// Get a buffer from the pool
+QByteArray FrameWriter::acquire_buffer() {
+  QMutexLocker locker(&mutex);
+  if (!free_buffers.isEmpty())
+    return free_buffers.takeLast();
+  locker.unlock();
+  // Reserving marks the capacity as fixed, it is not released on resize
+  QByteArray buffer;
+  buffer.reserve(default_buffer_size);
+  return buffer;
+}
+
+// Set the fsync policy
+void FrameWriter::set_fsync_policy(const FsyncPolicy _policy, const int _period) {
+  QMutexLocker locker(&mutex);
+  fsync_policy = _policy;
+  fsync_period = (_period < 1) ? 1 : _period;
+}
+
+// Mean write latency in microseconds
+double FrameWriter::get_mean_write_latency() const {
+  const quint64 frames = frames_written.load();
+  if (frames == 0)
+    return 0.0;
+  return static_cast<double> (total_write_latency.load()) / static_cast<double> (frames);
+}
+
+// Queue a frame to be written
+void FrameWriter::submit(const quint64 _id, const QString& _filename, const QByteArray& _data, const bool _detect_change, const quint64 _pose_key) {
+  FrameJob job;
+  job.id = _id;
+  job.filename = _filename;
+  job.data = _data;
+  job.detect_change = _detect_change;
+  job.pose_key = _pose_key;
+  enqueue_job(job);
+}
+
+// Queue a frame to be appended to an archive
+void FrameWriter::submit(const quint64 _id, const QSharedPointer<SphereArchiveWriter>& _archive, const SphereArchiveEntry& _entry, const QByteArray& _data, const bool _detect_change, const quint64 _pose_key) {
+  FrameJob job;
+  job.id = _id;
+  job.filename = _archive->get_filename();
+  job.data = _data;
+  job.archive = _archive;
+  job.entry = _entry;
+  job.detect_change = _detect_change;
+  job.pose_key = _pose_key;
+  enqueue_job(job);
+}
+
+// Queue a job
+void FrameWriter::enqueue_job(const FrameJob& _job) {
+  if ((queued_bytes += _job.data.size()) > max_queued_bytes.load())
+    saturated = true;
+  QMutexLocker locker(&mutex);
+  jobs.enqueue(_job);
+  job_available.wakeOne();
+}
+
+// Block the caller until every queued frame is written
+void FrameWriter::wait_for_done() {
+  QMutexLocker locker(&mutex);
+  while ((!jobs.isEmpty()) || (busy_threads > 0))
+    queue_empty.wait(&mutex);
+}
+
+// Loop of the writer threads
+void FrameWriter::process_frames() {
+  QMutexLocker locker(&mutex);
+  forever {
+    while (jobs.isEmpty() && (!stopping))
+      job_available.wait(&mutex);
+    if (jobs.isEmpty())
+      return;
+    FrameJob job = jobs.dequeue();
+    const FsyncPolicy policy = fsync_policy;
+    const int period = fsync_period;
+    ++busy_threads;
+    locker.unlock();
+
+    // Compare the frame with the previous one of its pose in the same
+    // directory or archive, out of the lock
+    ChangeDetector* detector = change_detector.load();
+    const QString target = job.archive.isNull() ? QFileInfo(job.filename).absolutePath() : job.filename;
+    QByteArray thumbnail;
+    const bool unchanged = job.detect_change && (detector != 0) && (!detector->is_changed(target, job.pose_key, job.data, thumbnail));
+    // Write the frame out of the lock
+    quint64 latency = 0;
+    const bool success = unchanged || write_frame(job, policy, period, latency);
+    if (unchanged) {
+      // Nothing is written, the frame is counted by the detector
+    }
+    else if (success) {
+      ++frames_written;
+      bytes_written += job.data.size();
+      total_write_latency += latency;
+      quint64 previous_max = max_write_latency.load();
+      while ((latency > previous_max) && (!max_write_latency.compare_exchange_weak(previous_max, latency)));
+      LatencyHistogram* histogram = latency_histogram.load();
+      if (histogram != 0)
+	histogram->record(latency);
+      // The frame stored becomes the reference of its pose
+      if (detector != 0)
+	detector->commit(target, job.pose_key, thumbnail);
+    }
+    else
+      ++write_errors;
+    // Release the back-pressure once half of the queue is written
+    const qint64 remaining = (queued_bytes -= job.data.size());
+    bool was_saturated = true;
+    if ((remaining <= max_queued_bytes.load() / 2) && saturated.compare_exchange_strong(was_saturated, false))
+      emit drained();
+    if (unchanged)
+      emit frame_unchanged(job.id, job.filename);
+    else
+      emit frame_written(job.id, job.filename, success);
+
+    // The archive is closed with its last frame, out of the lock
+    job.archive.clear();
+    locker.relock();
+    // Give the buffer back to the pool
+    if (free_buffers.size() < max_free_buffers)
+      free_buffers.append(job.data);
+    --busy_threads;
+    if (jobs.isEmpty() && (busy_threads == 0))
+      queue_empty.wakeAll();
+  }
+}
+
+// Write a frame on the disk
+bool FrameWriter::write_frame(const FrameJob& _job, const FsyncPolicy _policy, const int _period, quint64& _latency) {
+  QElapsedTimer timer;
+  timer.start();
+  const bool sync = (_policy == fsync_every_frame) || ((_policy == fsync_periodic) && (((fsync_tickets.fetch_add(1) + 1) % _period) == 0));
+  // Append to the archive
+  if (!_job.archive.isNull()) {
+    const bool success = _job.archive->append(_job.entry, _job.data);
+    if (sync)
+      _job.archive->sync();
+    _latency = static_cast<quint64> (timer.nsecsElapsed() / 1000);
+    return success;
+  }
+  QFile file(_job.filename);
+  if (!file.open(QIODevice::WriteOnly)) {
+    std::cout << "Error while writting the image file" << std::endl;
+    return false;
+  }
+  // Save the image
+  const bool success = (file.write(_job.data.constData(), _job.data.size()) == _job.data.size());
+  if (sync) {
+    file.flush();
+    ::fdatasync(file.handle());
+  }
+  // Close the file
+  file.close();
+  _latency = static_cast<quint64> (timer.nsecsElapsed() / 1000);
+  return success;
+}
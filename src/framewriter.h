@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FRAMEWRITER_H_
+#define FRAMEWRITER_H_
+
+// stl library
+#include <atomic>
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QSharedPointer>
+
+#include "spherearchive.h"
+#include "requestmetrics.h"
+#include "changedetector.h"
+
+class FrameWriter : public QObject
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // When the written frames are forced to the disk:
+  //   - fsync_never: left to the operating system
+  //   - fsync_every_frame: each file is synced before being closed
+  //   - fsync_periodic: every fsync_period-th frame is synced, the frames
+  //     before it are left to the operating system
+  enum FsyncPolicy { fsync_never, fsync_every_frame, fsync_periodic };
+
+  // Constructor - the frames are written by _thread_count threads
+  explicit FrameWriter(const int _thread_count = 2, QObject *parent = 0);
+  // Destructor - the queued frames are written before the threads stop
+  ~FrameWriter();
+
+  /* Buffer management */
+  // Get a buffer from the pool, the capacity of a recycled buffer is kept
+  // so that reading a frame into it does not allocate
+  QByteArray acquire_buffer();
+
+  /* Frame management */
+  // Queue a frame to be written, the buffer goes back to the pool afterwards.
+  // With _detect_change, the frame is dropped when the change detector finds
+  // it unchanged since the last frame of the pose _pose_key.
+  void submit(const quint64 _id, const QString& _filename, const QByteArray& _data, const bool _detect_change = false, const quint64 _pose_key = 0);
+  // Queue a frame to be appended to an archive
+  void submit(const quint64 _id, const QSharedPointer<SphereArchiveWriter>& _archive, const SphereArchiveEntry& _entry, const QByteArray& _data, const bool _detect_change = false, const quint64 _pose_key = 0);
+  // Block the caller until every queued frame is written
+  void wait_for_done();
+
+  // Back-pressure - the writer is saturated when more than max_queued_bytes
+  // are waiting, and drained() is emitted once half of them are written
+  inline bool is_saturated() const { return saturated.load(); }
+  inline void set_max_queued_bytes(const qint64 _bytes) { max_queued_bytes = _bytes; }
+  inline qint64 get_max_queued_bytes() const { return max_queued_bytes.load(); }
+
+  // Set the fsync policy, _period is used by fsync_periodic only
+  void set_fsync_policy(const FsyncPolicy _policy, const int _period = 16);
+
+  // Detector comparing the frames submitted with _detect_change, 0 to store
+  // every frame. The frames are decoded on the writer threads.
+  inline void set_change_detector(ChangeDetector* _detector) { change_detector = _detector; }
+
+  /* Counters */
+  inline qint64 get_queued_bytes() const { return queued_bytes.load(); }
+  inline quint64 get_frames_written() const { return frames_written.load(); }
+  inline quint64 get_bytes_written() const { return bytes_written.load(); }
+  inline quint64 get_write_errors() const { return write_errors.load(); }
+  // Write latency in microseconds, from the open to the close of the file
+  inline quint64 get_max_write_latency() const { return max_write_latency.load(); }
+  double get_mean_write_latency() const;
+  // Record the write latency of every frame in a histogram, 0 to stop
+  inline void set_latency_histogram(LatencyHistogram* _histogram) { latency_histogram = _histogram; }
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  // Frame waiting to be written
+  struct FrameJob {
+    quint64 id;
+    QString filename;
+    QByteArray data;
+    // Archive receiving the frame instead of a file, if any
+    QSharedPointer<SphereArchiveWriter> archive;
+    SphereArchiveEntry entry;
+    // Pose compared by the change detector, if any
+    bool detect_change;
+    quint64 pose_key;
+  };
+  // Queue a job
+  void enqueue_job(const FrameJob& _job);
+
+  // Thread running the write loop of the writer
+  class WriterThread : public QThread
+  {
+  public:
+    explicit WriterThread(FrameWriter* _writer) : writer(_writer) {}
+  protected:
+    void run() { writer->process_frames(); }
+  private:
+    FrameWriter* writer;
+  };
+
+  QList<WriterThread*> threads;
+  // Private members regarding the queue, protected by the mutex
+  QMutex mutex;
+  QWaitCondition job_available;
+  QWaitCondition queue_empty;
+  QQueue<FrameJob> jobs;
+  QList<QByteArray> free_buffers;
+  int busy_threads;
+  bool stopping;
+
+  // Private members regarding the buffers
+  static const int default_buffer_size = 256 * 1024;
+  static const int max_free_buffers = 32;
+
+  // Private members regarding the back-pressure
+  std::atomic<qint64> max_queued_bytes;
+  static const qint64 default_max_queued_bytes = 64 * 1024 * 1024;
+  std::atomic<bool> saturated;
+
+  // Private members regarding the fsync policy, protected by the mutex
+  FsyncPolicy fsync_policy;
+  int fsync_period;
+  // Ticket taken by each frame written with fsync_periodic, out of the
+  // mutex - every fsync_period-th ticket is synced whatever the thread
+  std::atomic<quint64> fsync_tickets;
+
+  // Private counters
+  std::atomic<qint64> queued_bytes;
+  std::atomic<quint64> frames_written;
+  std::atomic<quint64> bytes_written;
+  std::atomic<quint64> write_errors;
+  std::atomic<quint64> total_write_latency;
+  std::atomic<quint64> max_write_latency;
+  std::atomic<LatencyHistogram*> latency_histogram;
+  std::atomic<ChangeDetector*> change_detector;
+
+  // Loop of the writer threads
+  void process_frames();
+  // Write a frame on the disk, return the latency in microseconds
+  bool write_frame(const FrameJob& _job, const FsyncPolicy _policy, const int _period, quint64& _latency);
+
+signals:
+  // Emitted from a writer thread once a frame is on the disk
+  void frame_written(const quint64 _id, const QString& _filename, const bool _success);
+  // Emitted from a writer thread instead of frame_written() when a frame is
+  // dropped by the change detector
+  void frame_unchanged(const quint64 _id, const QString& _filename);
+  // Emitted from a writer thread when the writer is not saturated anymore
+  void drained();
+};
+
+#endif  // FRAMEWRITER_H_
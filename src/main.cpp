@@ -21,7 +21,7 @@
 
 #include <QCoreApplication>
 
-#include "sonysncrx550n.h"
+#include "camerafleet.h"
 
 #include <iostream>
 #include <sstream>
@@ -30,9 +30,23 @@ int main(int argc, char *argv[])
 {
   QCoreApplication a(argc, argv);
 
-  SonySNCRX550N sony_cam("192.168.0.100");
+  // The cameras are given on the command line
+  CameraFleet fleet;
+  for (int i = 1; i < argc; ++i)
+    fleet.add_camera(argv[i]);
+  if (fleet.size() == 0)
+    fleet.add_camera("192.168.0.100");
+  fleet.set_report_interval(10000);
 
-  sony_cam.spherical_acquisition(12, 8, 24, "oz-1", "f-inf", "./images/");
+  // The acquisitions are queued, leave once every request has been processed
+  QObject::connect(&fleet, SIGNAL(idle()), &a, SLOT(quit()));
+  fleet.spherical_acquisition(12, 8, 24, "oz-1", "f-inf", "./images/");
 
-  return a.exec();
+  const int status = a.exec();
+  // The last images are still queued in the writers, deliver their
+  // completion so that the journals record them
+  for (int i = 0; i < fleet.size(); ++i)
+    fleet.camera(i)->get_frame_writer()->wait_for_done();
+  QCoreApplication::processEvents();
+  return status;
 }
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "mjpegstream.h"
+
+// qt library
+#include <QDateTime>
+#include <QNetworkRequest>
+
+// stl library
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+FrameRingBuffer::FrameRingBuffer(const int _slots, const int _slot_capacity) :
+  ring_slots(0), slot_count((_slots < 2) ? 2 : _slots), slot_capacity(_slot_capacity),
+  next_sequence(1), writing(false), latest(0) {
+  ring_slots = new Slot[slot_count];
+  for (int i = 0; i < slot_count; ++i) {
+    ring_slots[i].guard.store(0);
+    ring_slots[i].length = 0;
+    ring_slots[i].data = new char[slot_capacity];
+  }
+}
+
+FrameRingBuffer::~FrameRingBuffer() {
+  for (int i = 0; i < slot_count; ++i)
+    delete[] ring_slots[i].data;
+  delete[] ring_slots;
+}
+
+// Get the slot of the next frame - the readers of the frame it held fail
+// from now on
+char* FrameRingBuffer::begin_write(int& _capacity) {
+  Slot& slot = ring_slots[next_sequence % slot_count];
+  slot.guard.store(2 * next_sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  writing.store(true, std::memory_order_release);
+  _capacity = slot_capacity;
+  return slot.data;
+}
+
+// Publish the frame written in the slot
+void FrameRingBuffer::commit_write(const int _length, const StreamFrameInfo& _info) {
+  Slot& slot = ring_slots[next_sequence % slot_count];
+  slot.length = _length;
+  slot.info = _info;
+  slot.info.sequence = next_sequence;
+  slot.guard.store(2 * next_sequence + 2, std::memory_order_release);
+  latest.store(next_sequence, std::memory_order_release);
+  ++next_sequence;
+  writing.store(false, std::memory_order_release);
+}
+
+// Drop the frame being written, its sequence is used by the next one
+void FrameRingBuffer::abort_write() {
+  ring_slots[next_sequence % slot_count].guard.store(0, std::memory_order_release);
+  writing.store(false, std::memory_order_release);
+}
+
+// Copy a given frame, false if it is not available anymore
+bool FrameRingBuffer::read(const quint64 _sequence, QByteArray& _frame, StreamFrameInfo& _info) const {
+  if ((_sequence == 0) || (_sequence > get_latest_sequence()))
+    return false;
+  const Slot& slot = ring_slots[_sequence % slot_count];
+  const quint64 guard = slot.guard.load(std::memory_order_acquire);
+  if (guard != 2 * _sequence + 2)
+    return false;
+  const int length = slot.length;
+  if ((length < 0) || (length > slot_capacity))
+    return false;
+  _frame.resize(length);
+  std::memcpy(_frame.data(), slot.data, length);
+  _info = slot.info;
+  // The producer did not start to overwrite the slot during the copy
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return (slot.guard.load(std::memory_order_relaxed) == guard);
+}
+
+// Copy the last published frame
+bool FrameRingBuffer::read_latest(QByteArray& _frame, StreamFrameInfo& _info) const {
+  for (int attempt = 0; attempt < slot_count; ++attempt)
+    if (read(get_latest_sequence(), _frame, _info))
+      return true;
+  return false;
+}
+
+// Copy the frame following _cursor and move the cursor
+bool FrameRingBuffer::read_next(quint64& _cursor, QByteArray& _frame, StreamFrameInfo& _info) const {
+  const quint64 last = get_latest_sequence();
+  if (last <= _cursor)
+    return false;
+  // The slot following the last frame may be under write already
+  quint64 sequence = _cursor + 1;
+  const quint64 oldest = (last + 2 > static_cast<quint64> (slot_count)) ? last + 2 - slot_count : 1;
+  if (sequence < oldest)
+    sequence = oldest;
+  for (; sequence <= get_latest_sequence(); ++sequence) {
+    if (read(sequence, _frame, _info)) {
+      _cursor = sequence;
+      return true;
+    }
+  }
+  return false;
+}
+
+MjpegStream::MjpegStream(QNetworkAccessManager* _net_acc_manager, const QString& _ip_address, QObject *parent) :
+  QObject(parent), net_acc_manager(_net_acc_manager), reply(0),
+  state(wait_boundary), boundary("--myboundary"),
+  part_data(0), part_capacity(0), part_filled(0), part_length(-1),
+  frames_received(0), frames_dropped(0) {
+  set_ip_address(_ip_address);
+  // Nothing is known about the position before the camera reports it
+  current_pose = StreamFrameInfo();
+  current_pose.zoom_code = 0xFFFF;
+  current_pose.focus_code = 0xFFFF;
+  current_pose.moving = true;
+  part_info = current_pose;
+}
+
+MjpegStream::~MjpegStream() {
+  stop();
+}
+
+// Address of the camera, used from the next start()
+void MjpegStream::set_ip_address(const QString& _ip_address) {
+  url_request_stream.setUrl("http://" + _ip_address + "/mjpeg");
+}
+
+// Open the long-lived connection on /mjpeg
+void MjpegStream::start(const int _fps) {
+  stop();
+  QUrl url(url_request_stream);
+  if (_fps > 0)
+    url.addQueryItem("speed", QString::number(_fps));
+  state = wait_boundary;
+  leftover.clear();
+  reply = net_acc_manager->get(QNetworkRequest(url));
+  connect(reply, SIGNAL(metaDataChanged()), this, SLOT(stream_header_received()));
+  connect(reply, SIGNAL(readyRead()), this, SLOT(stream_data_ready()));
+  connect(reply, SIGNAL(finished()), this, SLOT(stream_finished()));
+}
+
+// Close the connection, the frame being received is dropped
+void MjpegStream::stop() {
+  if (reply == 0)
+    return;
+  QNetworkReply* stream_reply = reply;
+  reply = 0;
+  disconnect(stream_reply, 0, this, 0);
+  stream_reply->abort();
+  stream_reply->deleteLater();
+  if (part_data != 0) {
+    ring_buffer.abort_write();
+    part_data = 0;
+  }
+}
+
+// Position tagged on the next frames
+void MjpegStream::set_pose(const double _pan, const double _tilt, const quint16 _zoom_code, const quint16 _focus_code, const bool _moving) {
+  current_pose.pan = _pan;
+  current_pose.tilt = _tilt;
+  current_pose.zoom_code = _zoom_code;
+  current_pose.focus_code = _focus_code;
+  current_pose.moving = _moving;
+}
+
+// slot to read the boundary from the headers of the reply. The camera
+// answers multipart/x-mixed-replace;boundary=--myboundary and separates the
+// parts with the boundary as given, other servers follow RFC 2046 and
+// precede it with "--".
+void MjpegStream::stream_header_received() {
+  if (reply == 0)
+    return;
+  const QByteArray content_type = reply->rawHeader("Content-Type");
+  const int position = content_type.indexOf("boundary=");
+  if (position < 0)
+    return;
+  QByteArray value = content_type.mid(position + 9);
+  const int end = value.indexOf(';');
+  if (end >= 0)
+    value = value.left(end);
+  value = value.trimmed();
+  if (value.startsWith('"') && value.endsWith('"') && (value.size() > 1))
+    value = value.mid(1, value.size() - 2);
+  if (!value.isEmpty())
+    boundary = value;
+}
+
+// Read a header line, from the leftover first
+bool MjpegStream::read_line(QByteArray& _line) {
+  const int newline = leftover.indexOf('\n');
+  if (newline >= 0) {
+    _line = leftover.left(newline + 1);
+    leftover.remove(0, newline + 1);
+    return true;
+  }
+  if (!reply->canReadLine())
+    return false;
+  _line = leftover + reply->readLine();
+  leftover.clear();
+  return true;
+}
+
+// Read the payload, from the leftover first
+qint64 MjpegStream::read_data(char* _data, const qint64 _max_size) {
+  qint64 size = 0;
+  if (!leftover.isEmpty()) {
+    size = std::min(static_cast<qint64> (leftover.size()), _max_size);
+    std::memcpy(_data, leftover.constData(), size);
+    leftover.remove(0, static_cast<int> (size));
+  }
+  if (size < _max_size) {
+    const qint64 read_size = reply->read(_data + size, _max_size - size);
+    if (read_size > 0)
+      size += read_size;
+  }
+  return size;
+}
+
+qint64 MjpegStream::bytes_available() const {
+  return leftover.size() + reply->bytesAvailable();
+}
+
+// The headers of a part are read, its payload goes straight into the ring
+void MjpegStream::begin_part() {
+  part_data = ring_buffer.begin_write(part_capacity);
+  part_filled = 0;
+  part_info = current_pose;
+  part_info.timestamp = QDateTime::currentDateTimeUtc().toMSecsSinceEpoch();
+  // Without length the end of the part is found by looking for the boundary
+  state = ((part_length > 0) && (part_length <= part_capacity)) ? read_body : scan_body;
+}
+
+// Publish the part in the ring
+void MjpegStream::end_part(const int _length) {
+  ring_buffer.commit_write(_length, part_info);
+  part_data = 0;
+  state = wait_boundary;
+  ++frames_received;
+  emit frame_received(ring_buffer.get_latest_sequence());
+}
+
+// slot to parse the data of the stream as it arrives. A part is made of:
+//   --myboundary
+//   Content-Type: image/jpeg
+//   [Content-Length: <size> | DataLen: <size>]
+//   <empty line>
+//   <JPEG>
+void MjpegStream::stream_data_ready() {
+  while (reply != 0) {
+    // Boundary and headers, line by line
+    if ((state == wait_boundary) || (state == read_headers)) {
+      QByteArray line;
+      if (!read_line(line))
+	return;
+      const QByteArray trimmed = line.trimmed();
+      if (state == wait_boundary) {
+	if ((trimmed == boundary) || (trimmed == "--" + boundary)) {
+	  state = read_headers;
+	  part_length = -1;
+	}
+	continue;
+      }
+      if (trimmed.isEmpty()) {
+	begin_part();
+	continue;
+      }
+      const int colon = trimmed.indexOf(':');
+      if (colon > 0) {
+	const QByteArray name = trimmed.left(colon).trimmed().toLower();
+	if ((name == "content-length") || (name == "datalen")) {
+	  bool ok;
+	  const int length = trimmed.mid(colon + 1).trimmed().toInt(&ok, 10);
+	  if (ok)
+	    part_length = length;
+	}
+      }
+      continue;
+    }
+    if (bytes_available() <= 0)
+      return;
+    // Payload of known length
+    if (state == read_body) {
+      part_filled += static_cast<int> (read_data(part_data + part_filled, part_length - part_filled));
+      if (part_filled == part_length)
+	end_part(part_length);
+      continue;
+    }
+    // Payload of unknown length, ended by CRLF and the boundary
+    const int room = part_capacity - part_filled;
+    if (room <= 0) {
+      std::cout << "The MJPEG frame is too large for the ring buffer !!! Dropping it !!!" << std::endl;
+      ring_buffer.abort_write();
+      part_data = 0;
+      ++frames_dropped;
+      state = wait_boundary;
+      continue;
+    }
+    const QByteArray marker = "\r\n" + boundary;
+    const QByteArray rfc_marker = "\r\n--" + boundary;
+    // The marker may straddle the previous read
+    const int from = std::max(0, part_filled - (rfc_marker.size() - 1));
+    part_filled += static_cast<int> (read_data(part_data + part_filled, room));
+    const char* end = part_data + part_filled;
+    const char* found = std::search(static_cast<const char*> (part_data + from), end, marker.constData(), marker.constData() + marker.size());
+    found = std::min(found, std::search(static_cast<const char*> (part_data + from), end, rfc_marker.constData(), rfc_marker.constData() + rfc_marker.size()));
+    if (found != end) {
+      // The bytes past the payload belong to the next part
+      leftover.prepend(QByteArray(found + 2, static_cast<int> (end - found - 2)));
+      end_part(static_cast<int> (found - part_data));
+    }
+  }
+}
+
+// slot called when the stream is closed by the camera
+void MjpegStream::stream_finished() {
+  if (reply == 0)
+    return;
+  std::cout << "The MJPEG stream was closed: " << reply->errorString().toStdString() << std::endl;
+  if (part_data != 0) {
+    ring_buffer.abort_write();
+    part_data = 0;
+    ++frames_dropped;
+  }
+  reply->deleteLater();
+  reply = 0;
+  emit closed();
+}
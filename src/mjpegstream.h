@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef MJPEGSTREAM_H_
+#define MJPEGSTREAM_H_
+
+// stl library
+#include <atomic>
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QUrl>
+#include <QNetworkReply>
+#include <QNetworkAccessManager>
+
+// Information attached to a frame of the stream
+struct StreamFrameInfo {
+  // Number of the frame in the stream, starting at 1
+  quint64 sequence;
+  // Time when the frame started to arrive, in ms since epoch, UTC
+  qint64 timestamp;
+  // Position of the camera at that time
+  double pan;
+  double tilt;
+  quint16 zoom_code;
+  quint16 focus_code;
+  // The head was moving - or not settled yet - at that time
+  bool moving;
+};
+
+// Ring of fixed size slots, written by a single producer and read by any
+// number of consumers without lock. Each slot is guarded by a sequence
+// counter: odd while the producer writes it, and 2 n + 2 once frame n is
+// published. A reader copies the slot and checks that the counter did not
+// change, otherwise the frame was overwritten and the read fails.
+class FrameRingBuffer
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - _slots frames of at most _slot_capacity bytes
+  explicit FrameRingBuffer(const int _slots = 8, const int _slot_capacity = 1024 * 1024);
+  ~FrameRingBuffer();
+
+  /* Producer */
+  // Get the slot of the next frame, the data can be written in place
+  char* begin_write(int& _capacity);
+  // Publish the frame written in the slot
+  void commit_write(const int _length, const StreamFrameInfo& _info);
+  // Drop the frame being written
+  void abort_write();
+  // Sequence of the frame being written, 0 when none - producer thread only
+  inline quint64 get_writing_sequence() const { return writing.load(std::memory_order_acquire) ? next_sequence : 0; }
+
+  /* Consumers */
+  // Sequence of the last published frame, 0 when none
+  inline quint64 get_latest_sequence() const { return latest.load(std::memory_order_acquire); }
+  // Copy a given frame, false if it is not available anymore
+  bool read(const quint64 _sequence, QByteArray& _frame, StreamFrameInfo& _info) const;
+  // Copy the last published frame
+  bool read_latest(QByteArray& _frame, StreamFrameInfo& _info) const;
+  // Subscription - copy the frame following _cursor and move the cursor.
+  // A consumer which fell behind skips to the oldest frame still available.
+  bool read_next(quint64& _cursor, QByteArray& _frame, StreamFrameInfo& _info) const;
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  struct Slot {
+    std::atomic<quint64> guard;
+    int length;
+    StreamFrameInfo info;
+    char* data;
+  };
+  Slot* ring_slots;
+  int slot_count;
+  int slot_capacity;
+  // Only accessed by the producer
+  quint64 next_sequence;
+  std::atomic<bool> writing;
+  std::atomic<quint64> latest;
+
+  FrameRingBuffer(const FrameRingBuffer&);
+  FrameRingBuffer& operator=(const FrameRingBuffer&);
+};
+
+class MjpegStream : public QObject
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - the stream uses the network stack of the camera
+  explicit MjpegStream(QNetworkAccessManager* _net_acc_manager, const QString& _ip_address, QObject *parent = 0);
+  ~MjpegStream();
+
+  // Address of the camera, used from the next start()
+  void set_ip_address(const QString& _ip_address);
+
+  // Open the long-lived connection on /mjpeg, _fps = 0 for the fastest rate
+  void start(const int _fps = 0);
+  void stop();
+  inline bool is_running() const { return (reply != 0); }
+
+  // Position tagged on the next frames, updated by the camera
+  void set_pose(const double _pan, const double _tilt, const quint16 _zoom_code, const quint16 _focus_code, const bool _moving);
+
+  // Frames received - consumers of any thread read them from here
+  inline const FrameRingBuffer& get_ring_buffer() const { return ring_buffer; }
+
+  // Counters
+  inline quint64 get_frames_received() const { return frames_received; }
+  inline quint64 get_frames_dropped() const { return frames_dropped; }
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  QNetworkAccessManager* net_acc_manager;
+  QUrl url_request_stream;
+  QNetworkReply* reply;
+  FrameRingBuffer ring_buffer;
+
+  // Private members regarding the multipart parser
+  enum ParserState { wait_boundary, read_headers, read_body, scan_body };
+  ParserState state;
+  // Separator of the parts, taken from the Content-Type of the reply - the
+  // parts start with it as given or, as in RFC 2046, preceded by "--"
+  QByteArray boundary;
+  // Bytes read past the end of a part, parsed before the reply
+  QByteArray leftover;
+  // Part being received, written in place in the ring buffer
+  char* part_data;
+  int part_capacity;
+  int part_filled;
+  int part_length;
+  StreamFrameInfo part_info;
+
+  // Position tagged on the frames
+  StreamFrameInfo current_pose;
+
+  // Counters
+  quint64 frames_received;
+  quint64 frames_dropped;
+
+  // Helpers of the parser, the leftover is consumed before the reply
+  bool read_line(QByteArray& _line);
+  qint64 read_data(char* _data, const qint64 _max_size);
+  qint64 bytes_available() const;
+  void begin_part();
+  void end_part(const int _length);
+
+private slots:
+  // slot to read the boundary from the headers of the reply
+  void stream_header_received();
+  // slot to parse the data of the stream as it arrives
+  void stream_data_ready();
+  // slot called when the stream is closed by the camera
+  void stream_finished();
+
+signals:
+  // Emitted when a frame is published in the ring buffer
+  void frame_received(const quint64 _sequence);
+  // Emitted when the camera closed the stream
+  void closed();
+};
+
+#endif  // MJPEGSTREAM_H_
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "mockcamera.h"
+
+// qt library
+#include <QHostAddress>
+#include <QStringList>
+#include <QUrl>
+
+// stl library
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// Limits of the head in motor steps - same as SonySNCRX550N
+static const double mock_min_pan_steps = -8160.0;
+static const double mock_max_pan_steps = 8160.0;
+static const double mock_min_tilt_steps = -2176.0;
+static const double mock_max_tilt_steps = 2176.0;
+
+MockSonySNCRX550N::MockSonySNCRX550N(QObject *parent) :
+  QTcpServer(parent), config(default_config()),
+  start_pan_steps(0), start_tilt_steps(0), target_pan_steps(0), target_tilt_steps(0),
+  motion_start(0), motion_duration(0), zoom_code(0x0000), focus_code(0x1000),
+  previous_zoom_code(0x0000), previous_focus_code(0x1000), lens_ready(0),
+  requests_served(0), failures_injected(0) {
+  clock.start();
+  answer_timer.setSingleShot(true);
+  connect(&answer_timer, SIGNAL(timeout()), this, SLOT(send_answers()));
+  stream_timer.setSingleShot(true);
+  connect(&stream_timer, SIGNAL(timeout()), this, SLOT(send_stream_frames()));
+}
+
+// Default behaviour
+MockCameraConfig MockSonySNCRX550N::default_config() {
+  MockCameraConfig default_values;
+  // 300 degrees per second at speed 24
+  default_values.step_time = 360.0 / 16320.0 / 300.0 * 1000.0;
+  default_values.zoom_time = 200;
+  default_values.latency = 5;
+  default_values.jpeg_size = 80 * 1024;
+  default_values.failure_rate = 0.0;
+  default_values.drop_connection = false;
+  default_values.stream_fps = 25;
+  return default_values;
+}
+
+// Address to give to the driver
+QString MockSonySNCRX550N::get_address() const {
+  QString host = serverAddress().toString();
+  if ((serverAddress() == QHostAddress::Any) || (serverAddress() == QHostAddress::AnyIPv6))
+    host = "127.0.0.1";
+  return host + ":" + QString::number(serverPort());
+}
+
+// Qt 4 entry point of the new connections
+void MockSonySNCRX550N::incomingConnection(int _socket_descriptor) {
+  QTcpSocket* socket = new QTcpSocket(this);
+  if (!socket->setSocketDescriptor(_socket_descriptor)) {
+    delete socket;
+    return;
+  }
+  read_buffers.insert(socket, QByteArray());
+  connect(socket, SIGNAL(readyRead()), this, SLOT(client_data_ready()));
+  connect(socket, SIGNAL(disconnected()), this, SLOT(client_disconnected()));
+}
+
+// slot to parse the requests of a connection
+void MockSonySNCRX550N::client_data_ready() {
+  QTcpSocket* socket = qobject_cast<QTcpSocket*> (sender());
+  if ((socket == 0) || (!read_buffers.contains(socket)))
+    return;
+  QByteArray& buffer = read_buffers[socket];
+  buffer.append(socket->readAll());
+  // The driver only sends GET requests, without body
+  int end_of_request;
+  while ((end_of_request = buffer.indexOf("\r\n\r\n")) >= 0) {
+    const QByteArray request = buffer.left(end_of_request);
+    buffer.remove(0, end_of_request + 4);
+    const int end_of_line = request.indexOf("\r\n");
+    const QList<QByteArray> request_line = ((end_of_line < 0) ? request : request.left(end_of_line)).split(' ');
+    bool drop = false;
+    int stream_interval = 0;
+    QByteArray answer;
+    if (request_line.size() < 2)
+      answer = http_answer(400, "text/plain", "Bad Request");
+    else
+      answer = handle_request(request_line.at(0), request_line.at(1), drop, stream_interval);
+    queue_answer(socket, answer, drop);
+    // The frames follow the headers of the stream
+    if (stream_interval > 0) {
+      StreamClient client;
+      client.interval = stream_interval;
+      client.next_frame = last_due.value(socket) + stream_interval;
+      stream_clients.insert(socket, client);
+      send_stream_frames();
+    }
+  }
+}
+
+// slot to forget a closed connection
+void MockSonySNCRX550N::client_disconnected() {
+  QTcpSocket* socket = qobject_cast<QTcpSocket*> (sender());
+  if (socket == 0)
+    return;
+  read_buffers.remove(socket);
+  last_due.remove(socket);
+  stream_clients.remove(socket);
+  socket->deleteLater();
+}
+
+// Queue the answer of a connection, after the latency and the previous
+// answers of the same connection
+void MockSonySNCRX550N::queue_answer(QTcpSocket* _socket, const QByteArray& _data, const bool _drop) {
+  qint64 due = clock.elapsed() + config.latency;
+  if (last_due.value(_socket, 0) > due)
+    due = last_due.value(_socket);
+  last_due.insert(_socket, due);
+  PendingAnswer answer;
+  answer.socket = _socket;
+  answer.data = _data;
+  answer.drop = _drop;
+  pending_answers.insert(due, answer);
+  send_answers();
+}
+
+// slot to send the answers which are due
+void MockSonySNCRX550N::send_answers() {
+  const qint64 now = clock.elapsed();
+  while ((!pending_answers.isEmpty()) && (pending_answers.begin().key() <= now)) {
+    const PendingAnswer answer = pending_answers.begin().value();
+    pending_answers.erase(pending_answers.begin());
+    if (answer.socket.isNull())
+      continue;
+    if (answer.drop)
+      answer.socket->abort();
+    else
+      answer.socket->write(answer.data);
+  }
+  if (!pending_answers.isEmpty())
+    answer_timer.start(static_cast<int> (pending_answers.begin().key() - now));
+}
+
+// slot to send the frames of the streams which are due, a slow client
+// skips the frames it missed
+void MockSonySNCRX550N::send_stream_frames() {
+  // The headers of a new stream leave before its first frame
+  send_answers();
+  const qint64 now = clock.elapsed();
+  qint64 next = -1;
+  QByteArray part;
+  for (QHash<QTcpSocket*, StreamClient>::iterator it = stream_clients.begin(); it != stream_clients.end(); ++it) {
+    StreamClient& client = it.value();
+    if (client.next_frame <= now) {
+      if (part.isEmpty()) {
+	const QByteArray jpeg = make_jpeg();
+	part = "--myboundary\r\nContent-Type: image/jpeg\r\nDataLen: " + QByteArray::number(jpeg.size()) + "\r\n\r\n" + jpeg + "\r\n";
+      }
+      it.key()->write(part);
+      client.next_frame = std::max(client.next_frame + client.interval, now + 1);
+    }
+    if ((next < 0) || (client.next_frame < next))
+      next = client.next_frame;
+  }
+  if (next >= 0)
+    stream_timer.start(static_cast<int> (next - now));
+}
+
+// Position of the head at the current time
+void MockSonySNCRX550N::current_position(double& _pan_steps, double& _tilt_steps) const {
+  const qint64 elapsed = clock.elapsed() - motion_start;
+  if ((motion_duration <= 0) || (elapsed >= motion_duration)) {
+    _pan_steps = target_pan_steps;
+    _tilt_steps = target_tilt_steps;
+    return;
+  }
+  const double progress = static_cast<double> (elapsed) / static_cast<double> (motion_duration);
+  _pan_steps = start_pan_steps + (target_pan_steps - start_pan_steps) * progress;
+  _tilt_steps = start_tilt_steps + (target_tilt_steps - start_tilt_steps) * progress;
+}
+
+// Start a motion toward the given target, the axes move together
+void MockSonySNCRX550N::move_to(const double _pan_steps, const double _tilt_steps, const long _speed) {
+  current_position(start_pan_steps, start_tilt_steps);
+  target_pan_steps = std::max(mock_min_pan_steps, std::min(mock_max_pan_steps, _pan_steps));
+  target_tilt_steps = std::max(mock_min_tilt_steps, std::min(mock_max_tilt_steps, _tilt_steps));
+  const double speed_factor = ((_speed < 1) ? 1.0 : static_cast<double> (_speed)) / 24.0;
+  const double steps = std::max(std::fabs(target_pan_steps - start_pan_steps), std::fabs(target_tilt_steps - start_tilt_steps));
+  motion_start = clock.elapsed();
+  motion_duration = static_cast<qint64> (std::ceil(steps * config.step_time / speed_factor));
+}
+
+// Handle a request and build its answer
+QByteArray MockSonySNCRX550N::handle_request(const QByteArray& _method, const QByteArray& _target, bool& _drop, int& _stream_interval) {
+  ++requests_served;
+  _drop = false;
+  _stream_interval = 0;
+  if (_method != "GET")
+    return http_answer(405, "text/plain", "Method Not Allowed");
+  // Failure injection
+  if ((config.failure_rate > 0.0) && (std::rand() < config.failure_rate * RAND_MAX)) {
+    ++failures_injected;
+    _drop = config.drop_connection;
+    return http_answer(500, "text/plain", "Internal Server Error");
+  }
+  const QUrl url = QUrl::fromEncoded("http://camera" + _target);
+  const QString path = url.path();
+  if (path == "/command/ptzf.cgi") {
+    if (url.hasQueryItem("relativepantilt") || url.hasQueryItem("absolutepantilt")) {
+      const bool relative = url.hasQueryItem("relativepantilt");
+      const QStringList params = url.queryItemValue(relative ? "relativepantilt" : "absolutepantilt").split(",", QString::SkipEmptyParts);
+      if (params.size() != 3)
+	return http_answer(400, "text/plain", "Bad Request");
+      double pan_steps = parse_steps(params.at(0));
+      double tilt_steps = parse_steps(params.at(1));
+      if (relative) {
+	double current_pan, current_tilt;
+	current_position(current_pan, current_tilt);
+	pan_steps += current_pan;
+	tilt_steps += current_tilt;
+      }
+      move_to(pan_steps, tilt_steps, params.at(2).toLong());
+    }
+    bool ok;
+    if (clock.elapsed() >= lens_ready) {
+      previous_zoom_code = zoom_code;
+      previous_focus_code = focus_code;
+    }
+    if (url.hasQueryItem("absolutezoom")) {
+      zoom_code = static_cast<quint16> (url.queryItemValue("absolutezoom").toUInt(&ok, 16));
+      lens_ready = clock.elapsed() + config.zoom_time;
+    }
+    if (url.hasQueryItem("absolutefocus")) {
+      focus_code = static_cast<quint16> (url.queryItemValue("absolutefocus").toUInt(&ok, 16));
+      lens_ready = clock.elapsed() + config.zoom_time;
+    }
+    return http_answer(204, "text/plain", QByteArray());
+  }
+  if (path == "/command/inquiry.cgi") {
+    double pan_steps, tilt_steps;
+    current_position(pan_steps, tilt_steps);
+    const bool lens_moving = (clock.elapsed() < lens_ready);
+    const QString answer = "AbsolutePTZF=" + format_code(static_cast<int> (std::round(pan_steps))) + "," + format_code(static_cast<int> (std::round(tilt_steps))) + "," +
+      format_code(lens_moving ? previous_zoom_code : zoom_code) + "," + format_code(lens_moving ? previous_focus_code : focus_code);
+    return http_answer(200, "text/plain", answer.toLatin1());
+  }
+  if (path == "/oneshotimage.jpg")
+    return http_answer(200, "image/jpeg", make_jpeg());
+  if (path == "/mjpeg") {
+    bool ok = false;
+    const int fps = url.queryItemValue("speed").toInt(&ok);
+    _stream_interval = std::max(1, 1000 / ((ok && (fps > 0)) ? fps : std::max(1, config.stream_fps)));
+    // No length, the parts go on until the connection is closed
+    return "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace;boundary=--myboundary\r\nConnection: close\r\n\r\n";
+  }
+  return http_answer(404, "text/plain", "Not Found");
+}
+
+// Positions are sent as 16 bits two's complement, or with a minus sign
+qint16 MockSonySNCRX550N::parse_steps(const QString& _hexa) {
+  bool ok;
+  const int value = _hexa.toInt(&ok, 16);
+  return static_cast<qint16> (ok ? value : 0);
+}
+
+// Position encoded as the camera does, on 4 hexadecimal digits
+QString MockSonySNCRX550N::format_code(const int _value) {
+  return QString::number(static_cast<quint16> (_value), 16).toUpper().rightJustified(4, '0');
+}
+
+// Build a HTTP/1.1 answer keeping the connection alive
+QByteArray MockSonySNCRX550N::http_answer(const int _status, const QByteArray& _content_type, const QByteArray& _body) {
+  QByteArray reason = "OK";
+  if (_status == 204)
+    reason = "No Content";
+  else if (_status == 400)
+    reason = "Bad Request";
+  else if (_status == 404)
+    reason = "Not Found";
+  else if (_status == 405)
+    reason = "Method Not Allowed";
+  else if (_status == 500)
+    reason = "Internal Server Error";
+  QByteArray answer = "HTTP/1.1 " + QByteArray::number(_status) + " " + reason + "\r\n";
+  answer += "Content-Type: " + _content_type + "\r\n";
+  answer += "Content-Length: " + QByteArray::number(_body.size()) + "\r\n";
+  answer += "Connection: keep-alive\r\n\r\n";
+  answer += _body;
+  return answer;
+}
+
+// JPEG of the configured size - SOI, filler and EOI markers
+QByteArray MockSonySNCRX550N::make_jpeg() const {
+  QByteArray jpeg((config.jpeg_size < 4) ? 4 : config.jpeg_size, static_cast<char> (0x55));
+  jpeg[0] = static_cast<char> (0xFF);
+  jpeg[1] = static_cast<char> (0xD8);
+  jpeg[jpeg.size() - 2] = static_cast<char> (0xFF);
+  jpeg[jpeg.size() - 1] = static_cast<char> (0xD9);
+  return jpeg;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef MOCKCAMERA_H_
+#define MOCKCAMERA_H_
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMultiMap>
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+
+// Behaviour of the mock camera
+struct MockCameraConfig {
+  // Time to travel one motor step at speed 24, in ms
+  double step_time;
+  // Time to reach a new zoom or focus position, in ms
+  int zoom_time;
+  // Time before an answer is sent, in ms
+  int latency;
+  // Size of the JPEG returned by oneshotimage.jpg, in bytes
+  int jpeg_size;
+  // Probability for a request to fail, with a 500 answer or - when
+  // drop_connection is set - by closing the connection
+  double failure_rate;
+  bool drop_connection;
+  // Frames per second of /mjpeg when the request does not give its speed
+  int stream_fps;
+};
+
+// Stand-in for the Sony SNC-RX550N serving the CGI used by the driver over
+// HTTP/1.1 with keep-alive:
+//   - /command/ptzf.cgi - relativepantilt, absolutepantilt, absolutezoom and
+//     absolutefocus, the head then moves at the configured speed
+//   - /command/inquiry.cgi?inq=ptzf - position of the head while it moves
+//   - /oneshotimage.jpg - a JPEG of the configured size
+//   - /mjpeg[?speed=<fps>] - the same JPEG as multipart/x-mixed-replace
+//     parts separated by --myboundary, until the connection is closed
+class MockSonySNCRX550N : public QTcpServer
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - call listen() to serve
+  explicit MockSonySNCRX550N(QObject *parent = 0);
+
+  // Default behaviour - a few ms of latency, 80 KB images and no failure
+  static MockCameraConfig default_config();
+  inline void set_config(const MockCameraConfig& _config) { config = _config; }
+  inline const MockCameraConfig& get_config() const { return config; }
+
+  // Address to give to the driver, e.g. 127.0.0.1:<port>
+  QString get_address() const;
+
+  // Counters
+  inline quint64 get_requests_served() const { return requests_served; }
+  inline quint64 get_failures_injected() const { return failures_injected; }
+
+  /* PROTECTED MEMBERS AND FUNCTIONS */
+
+protected:
+  // Qt 4 entry point of the new connections
+  void incomingConnection(int _socket_descriptor);
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  MockCameraConfig config;
+
+  // Private members regarding the motion of the head, in motor steps. The
+  // head goes linearly from the start to the target.
+  double start_pan_steps;
+  double start_tilt_steps;
+  double target_pan_steps;
+  double target_tilt_steps;
+  qint64 motion_start;
+  qint64 motion_duration;
+  quint16 zoom_code;
+  quint16 focus_code;
+  // The lens reports its previous position until it is ready
+  quint16 previous_zoom_code;
+  quint16 previous_focus_code;
+  qint64 lens_ready;
+  QElapsedTimer clock;
+
+  // Private members regarding the connections
+  QHash<QTcpSocket*, QByteArray> read_buffers;
+  // Answers waiting for their latency, ordered by due time
+  struct PendingAnswer {
+    QPointer<QTcpSocket> socket;
+    QByteArray data;
+    bool drop;
+  };
+  QMultiMap<qint64, PendingAnswer> pending_answers;
+  QTimer answer_timer;
+  // The answers of a connection leave in order
+  QHash<QTcpSocket*, qint64> last_due;
+  // Connections on /mjpeg, each with its frame interval and next frame due
+  struct StreamClient {
+    int interval;
+    qint64 next_frame;
+  };
+  QHash<QTcpSocket*, StreamClient> stream_clients;
+  QTimer stream_timer;
+
+  quint64 requests_served;
+  quint64 failures_injected;
+
+  // Position of the head at the current time
+  void current_position(double& _pan_steps, double& _tilt_steps) const;
+  // Start a motion toward the given target
+  void move_to(const double _pan_steps, const double _tilt_steps, const long _speed);
+  // Handle a request and build its answer
+  // _stream_interval is set to the frame interval in ms of a /mjpeg request,
+  // 0 otherwise
+  QByteArray handle_request(const QByteArray& _method, const QByteArray& _target, bool& _drop, int& _stream_interval);
+  // Queue the answer of a connection
+  void queue_answer(QTcpSocket* _socket, const QByteArray& _data, const bool _drop);
+
+  // Helpers regarding the encoding of the positions
+  static qint16 parse_steps(const QString& _hexa);
+  static QString format_code(const int _value);
+  static QByteArray http_answer(const int _status, const QByteArray& _content_type, const QByteArray& _body);
+  // JPEG of the configured size
+  QByteArray make_jpeg() const;
+
+private slots:
+  // slot to parse the requests of a connection
+  void client_data_ready();
+  // slot to forget a closed connection
+  void client_disconnected();
+  // slot to send the answers which are due
+  void send_answers();
+  // slot to send the frames of the streams which are due
+  void send_stream_frames();
+};
+
+#endif  // MOCKCAMERA_H_
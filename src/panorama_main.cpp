@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QString>
+#include <QStringList>
+
+#include "panoramabuilder.h"
+
+#include <iostream>
+
+// Build the equirectangular panorama of sphere directories and archives
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+  const QStringList arguments = a.arguments();
+
+  int width = 8192;
+  int threads = 0;
+  QStringList inputs;
+  for (int i = 1; i < arguments.size(); ++i) {
+    if ((arguments.at(i) == "--width") && (i + 1 < arguments.size()))
+      width = arguments.at(++i).toInt();
+    else if ((arguments.at(i) == "--threads") && (i + 1 < arguments.size()))
+      threads = arguments.at(++i).toInt();
+    else
+      inputs.append(arguments.at(i));
+  }
+  if (inputs.size() < 2) {
+    std::cout << "Usage: panorama [--width <pixels>] [--threads <count>] <output directory> <sphere directory or archive>..." << std::endl;
+    return 1;
+  }
+
+  PanoramaBuilder builder(inputs.takeFirst(), width);
+  for (int i = 0; i < inputs.size(); ++i) {
+    if (QFileInfo(inputs.at(i)).isDir())
+      builder.add_directory(inputs.at(i));
+    else
+      builder.add_archive(inputs.at(i));
+  }
+  std::cout << builder.size() << " frames - canvas of " << builder.get_canvas_width() << "x" << builder.get_canvas_height() << " - " << builder.get_dirty_tiles() << " tiles to render" << std::endl;
+
+  QElapsedTimer timer;
+  timer.start();
+  const int tiles = builder.render(threads);
+  std::cout << tiles << " tiles written in " << timer.elapsed() / 1000.0 << " s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "panoramabuilder.h"
+
+// qt library
+#include <QBuffer>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QLatin1String>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QSize>
+#include <QStringList>
+#include <QThreadPool>
+
+// stl library
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ptzcodec.h"
+
+static const double degree = M_PI / 180.0;
+
+PanoramaBuilder::PanoramaBuilder(const QString& _output_directory, const int _canvas_width, QObject *parent) :
+  QObject(parent), output_directory(_output_directory), decoded_bytes(0),
+  max_decoded_bytes(default_max_decoded_bytes), tiles_written(0) {
+  const int size = tile_size;
+  canvas_width = std::max(size, _canvas_width);
+  canvas_height = canvas_width / 2;
+  tile_columns = (canvas_width + size - 1) / size;
+  tile_rows = (canvas_height + size - 1) / size;
+}
+
+QString PanoramaBuilder::tile_filename(const int _row, const int _column) const {
+  return QDir(output_directory).filePath("tile-" + QString::number(_row) + "-" + QString::number(_column) + ".jpg");
+}
+
+// Add the images of a sphere directory
+int PanoramaBuilder::add_directory(const QString& _directory) {
+  const QDir directory(_directory);
+  if (!directory.exists()) {
+    std::cout << "The directory of the frames does not exist !!! No frame added !!!" << std::endl;
+    return 0;
+  }
+  const QStringList files = directory.entryList(QStringList("*.jpg"), QDir::Files, QDir::Name);
+  int count = 0;
+  for (int i = 0; i < files.size(); ++i)
+    if (add_image(directory.filePath(files.at(i))))
+      ++count;
+  return count;
+}
+
+// Add the frames of a sphere archive, read in place
+int PanoramaBuilder::add_archive(const QString& _filename) {
+  QSharedPointer<SphereArchiveReader> archive(new SphereArchiveReader(_filename));
+  if (!archive->is_open()) {
+    std::cout << "Error while opening the archive !!! No frame added !!!" << std::endl;
+    return 0;
+  }
+  int count = 0;
+  for (int i = 0; i < archive->size(); ++i) {
+    const SphereArchiveEntry& entry = archive->entry(i);
+    const char* zoom = PtzCodec::zoom_key(entry.zoom_code);
+    const char* focus = PtzCodec::focus_key(entry.focus_code);
+    if ((zoom == 0) || (focus == 0))
+      continue;
+    PanoramaFrame frame;
+    frame.pose.pan = PtzCodec::steps_to_pan(entry.pan_steps);
+    frame.pose.tilt = PtzCodec::steps_to_tilt(entry.tilt_steps);
+    frame.pose.zoom = QLatin1String(zoom);
+    frame.pose.focus = QLatin1String(focus);
+    frame.time = QDateTime::fromMSecsSinceEpoch(entry.timestamp).toUTC();
+    frame.archive = archive;
+    frame.archive_index = i;
+    if (add_frame(frame))
+      ++count;
+  }
+  return count;
+}
+
+// Add an image named as by the acquisitions
+bool PanoramaBuilder::add_image(const QString& _filename) {
+  // <tilt>-<pan>-<zoom>-<focus>-<time>.jpg, the angles may be negative
+  QRegExp name("^(-?[0-9.]+(?:e[-+]?[0-9]+)?)-(-?[0-9.]+(?:e[-+]?[0-9]+)?)-([od]z-[0-9]+)-(f-[^-]+)-(.+)\\.jpg$");
+  if (name.indexIn(QFileInfo(_filename).fileName()) == -1) {
+    std::cout << "The name of the image does not give its pose !!! " << _filename.toStdString() << " is skipped !!!" << std::endl;
+    return false;
+  }
+  PanoramaFrame frame;
+  frame.pose.tilt = name.cap(1).toDouble();
+  frame.pose.pan = name.cap(2).toDouble();
+  frame.pose.zoom = name.cap(3);
+  frame.pose.focus = name.cap(4);
+  // The time is written in UTC by the acquisitions, a time without zone is
+  // taken as local
+  frame.time = QDateTime::fromString(name.cap(5), Qt::ISODate).toUTC();
+  frame.filename = _filename;
+  frame.archive_index = -1;
+  return add_frame(frame);
+}
+
+// slot to follow a running acquisition stored in a directory
+void PanoramaBuilder::image_grabbed(const quint64 _request_id, const QString& _filename) {
+  Q_UNUSED(_request_id);
+  // The frames of an archive are added once it is closed
+  if (_filename.endsWith(".jpg"))
+    add_image(_filename);
+}
+
+// Add or replace a frame and mark its tiles to render
+bool PanoramaBuilder::add_frame(PanoramaFrame& _frame) {
+  const quint16 zoom = PtzCodec::zoom_code(_frame.pose.zoom);
+  const quint16 focus = PtzCodec::focus_code(_frame.pose.focus);
+  if ((zoom == PtzCodec::invalid_code) || (focus == PtzCodec::invalid_code))
+    return false;
+  // Bounding box of the circle through the corners of the frame
+  const double half_width = std::tan(ScanPlanner::horizontal_fov(_frame.pose.zoom) * degree / 2.0);
+  const double half_height = std::tan(ScanPlanner::vertical_fov(_frame.pose.zoom) * degree / 2.0);
+  const double radius = std::atan(std::sqrt(half_width * half_width + half_height * half_height)) / degree;
+  _frame.tilt_min = _frame.pose.tilt - radius;
+  _frame.tilt_max = _frame.pose.tilt + radius;
+  if ((_frame.tilt_min <= -90.0) || (_frame.tilt_max >= 90.0)) {
+    // The frame sees a pole, every pan
+    _frame.pan_min = -180.0;
+    _frame.pan_max = 180.0;
+  }
+  else {
+    const double half_pan = std::asin(std::min(1.0, std::sin(radius * degree) / std::cos(_frame.pose.tilt * degree))) / degree;
+    _frame.pan_min = _frame.pose.pan - half_pan;
+    _frame.pan_max = _frame.pose.pan + half_pan;
+  }
+  PtzPose pose = {PtzCodec::pan_to_steps(_frame.pose.pan), PtzCodec::tilt_to_steps(_frame.pose.tilt), zoom, focus};
+  const quint64 key = PtzCodec::pose_key(pose);
+  auto it = pose_index.find(key);
+  if (it != pose_index.end()) {
+    // Keep the most recent frame of the pose, a frame of unknown time does
+    // not replace a dated one
+    PanoramaFrame& previous = frames[it.value()];
+    if (previous.time.isValid() && ((!_frame.time.isValid()) || (_frame.time < previous.time)))
+      return false;
+    mark_dirty(previous);
+    previous = _frame;
+    forget_image(it.value());
+  }
+  else {
+    pose_index.insert(key, static_cast<int> (frames.size()));
+    frames.push_back(_frame);
+  }
+  mark_dirty(_frame);
+  return true;
+}
+
+// Mark the tiles overlapped by a frame
+void PanoramaBuilder::mark_dirty(const PanoramaFrame& _frame) {
+  const double step = 360.0 / canvas_width;
+  const int size = tile_size;
+  for (int row = 0; row < tile_rows; ++row) {
+    const double tilt_max = 90.0 - row * size * step;
+    const double tilt_min = std::max(-90.0, tilt_max - size * step);
+    for (int column = 0; column < tile_columns; ++column) {
+      const double pan_min = -180.0 + column * size * step;
+      const double pan_max = std::min(180.0, pan_min + size * step);
+      if (overlaps(_frame, pan_min, pan_max, tilt_min, tilt_max))
+	dirty_tiles.insert(row * tile_columns + column);
+    }
+  }
+}
+
+bool PanoramaBuilder::overlaps(const PanoramaFrame& _frame, const double _pan_min, const double _pan_max, const double _tilt_min, const double _tilt_max) {
+  if ((_frame.tilt_max < _tilt_min) || (_frame.tilt_min > _tilt_max))
+    return false;
+  // The pan wraps around
+  for (int turn = -1; turn <= 1; ++turn)
+    if ((_frame.pan_min + turn * 360.0 < _pan_max) && (_frame.pan_max + turn * 360.0 > _pan_min))
+      return true;
+  return false;
+}
+
+// Render the tiles overlapped by the frames added since the last call
+int PanoramaBuilder::render(const int _thread_count) {
+  if (dirty_tiles.isEmpty())
+    return 0;
+  QDir().mkpath(output_directory);
+  std::vector<int> tiles(dirty_tiles.constBegin(), dirty_tiles.constEnd());
+  // Neighbouring tiles share their frames, they are rendered together
+  std::sort(tiles.begin(), tiles.end());
+  dirty_tiles.clear();
+  tiles_written = 0;
+  QThreadPool pool;
+  if (_thread_count > 0)
+    pool.setMaxThreadCount(_thread_count);
+  for (size_t i = 0; i < tiles.size(); ++i)
+    pool.start(new TileTask(this, tiles[i]));
+  pool.waitForDone();
+  // Release the decoded frames and keep the failed tiles for the next call
+  QMutexLocker locker(&mutex);
+  decoded.clear();
+  decoded_order.clear();
+  decoded_bytes = 0;
+  for (int i = 0; i < failed_tiles.size(); ++i)
+    dirty_tiles.insert(failed_tiles.at(i));
+  failed_tiles.clear();
+  return tiles_written.load();
+}
+
+// Decoded frame, shared by the tiles through the cache
+QImage PanoramaBuilder::frame_image(const int _index) {
+  {
+    QMutexLocker locker(&mutex);
+    auto it = decoded.find(_index);
+    if (it != decoded.end()) {
+      decoded_order.removeOne(_index);
+      decoded_order.append(_index);
+      return it.value();
+    }
+  }
+  // Decode out of the lock, two tiles may decode the same frame
+  const QImage image = decode(frames[_index]);
+  if (image.isNull())
+    return image;
+  QMutexLocker locker(&mutex);
+  if (!decoded.contains(_index)) {
+    decoded.insert(_index, image);
+    decoded_order.append(_index);
+    decoded_bytes += image.byteCount();
+    // The images evicted stay valid for the tiles using them
+    while ((decoded_bytes > max_decoded_bytes) && (decoded_order.size() > 1)) {
+      const int oldest = decoded_order.takeFirst();
+      decoded_bytes -= decoded.value(oldest).byteCount();
+      decoded.remove(oldest);
+    }
+  }
+  return image;
+}
+
+void PanoramaBuilder::forget_image(const int _index) {
+  QMutexLocker locker(&mutex);
+  auto it = decoded.find(_index);
+  if (it == decoded.end())
+    return;
+  decoded_bytes -= it.value().byteCount();
+  decoded.erase(it);
+  decoded_order.removeOne(_index);
+}
+
+// Decode a frame no larger than its footprint on the canvas - the reader
+// scales the JPEG down while decoding
+QImage PanoramaBuilder::decode(const PanoramaFrame& _frame) const {
+  QByteArray data;
+  if (!_frame.archive.isNull()) {
+    const SphereArchiveEntry& entry = _frame.archive->entry(_frame.archive_index);
+    data = QByteArray::fromRawData(reinterpret_cast<const char*> (_frame.archive->frame_data(_frame.archive_index)), static_cast<int> (entry.length));
+  }
+  else {
+    QFile file(_frame.filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+      std::cout << "Error while reading the image file" << std::endl;
+      return QImage();
+    }
+    data = file.readAll();
+  }
+  QBuffer buffer;
+  buffer.setData(data);
+  buffer.open(QIODevice::ReadOnly);
+  QImageReader reader(&buffer, "jpeg");
+  const QSize size = reader.size();
+  const double footprint = ScanPlanner::horizontal_fov(_frame.pose.zoom) * canvas_width / 360.0;
+  if (size.isValid() && (footprint < size.width())) {
+    const double scale = footprint / size.width();
+    reader.setScaledSize(QSize(std::max(1, static_cast<int> (std::ceil(size.width() * scale))), std::max(1, static_cast<int> (std::ceil(size.height() * scale)))));
+  }
+  QImage image = reader.read();
+  if (image.isNull()) {
+    std::cout << "Error while decoding the image !!! The frame is skipped !!!" << std::endl;
+    return image;
+  }
+  if (image.format() != QImage::Format_RGB32)
+    image = image.convertToFormat(QImage::Format_RGB32);
+  return image;
+}
+
+// Project the frames overlapping a tile and write it. Each pixel of the tile
+// is a direction, looked up in every frame through the pinhole model of the
+// camera. The frames are feathered towards their borders and the zoomed ones
+// weigh more, their details win over the wide frames.
+void PanoramaBuilder::render_tile(const int _tile) {
+  const int size = tile_size;
+  const int row = _tile / tile_columns;
+  const int column = _tile % tile_columns;
+  const int x0 = column * size;
+  const int y0 = row * size;
+  const int width = std::min(size, canvas_width - x0);
+  const int height = std::min(size, canvas_height - y0);
+  const double step = 360.0 / canvas_width;
+  const double pan_min = -180.0 + x0 * step;
+  const double tilt_max = 90.0 - y0 * step;
+  std::vector<int> candidates;
+  for (size_t i = 0; i < frames.size(); ++i)
+    if (overlaps(frames[i], pan_min, pan_min + width * step, tilt_max - height * step, tilt_max))
+      candidates.push_back(static_cast<int> (i));
+  if (candidates.empty())
+    return;
+
+  // Sums of the tile and samples of a row, by channel
+  std::vector<float> sums(4 * size * height, 0.0f);
+  float* sum_red = &sums[0];
+  float* sum_green = sum_red + size * height;
+  float* sum_blue = sum_green + size * height;
+  float* sum_weight = sum_blue + size * height;
+  std::vector<float> samples(4 * size);
+  float* red = &samples[0];
+  float* green = red + size;
+  float* blue = green + size;
+  float* weight = blue + size;
+  std::vector<double> sin_pan(width);
+  std::vector<double> cos_pan(width);
+  for (int x = 0; x < width; ++x) {
+    const double pan = (pan_min + (x + 0.5) * step) * degree;
+    sin_pan[x] = std::sin(pan);
+    cos_pan[x] = std::cos(pan);
+  }
+
+  for (size_t c = 0; c < candidates.size(); ++c) {
+    const PanoramaFrame& frame = frames[candidates[c]];
+    const QImage image = frame_image(candidates[c]);
+    if (image.isNull())
+      continue;
+    // Axes of the camera - forward, right and up
+    const double pan = frame.pose.pan * degree;
+    const double tilt = frame.pose.tilt * degree;
+    const double forward[3] = {std::cos(tilt) * std::sin(pan), std::sin(tilt), std::cos(tilt) * std::cos(pan)};
+    const double right[3] = {std::cos(pan), 0.0, -std::sin(pan)};
+    const double up[3] = {-std::sin(tilt) * std::sin(pan), std::cos(tilt), -std::sin(tilt) * std::cos(pan)};
+    const int image_width = image.width();
+    const int image_height = image.height();
+    const double center_x = image_width / 2.0;
+    const double center_y = image_height / 2.0;
+    const double focal_x = center_x / std::tan(ScanPlanner::horizontal_fov(frame.pose.zoom) * degree / 2.0);
+    const double focal_y = center_y / std::tan(ScanPlanner::vertical_fov(frame.pose.zoom) * degree / 2.0);
+    const float zoom_weight = static_cast<float> (ScanPlanner::magnification(frame.pose.zoom));
+
+    for (int y = 0; y < height; ++y) {
+      const double tilt_pixel = (tilt_max - (y + 0.5) * step) * degree;
+      const double cos_tilt = std::cos(tilt_pixel);
+      const double sin_tilt = std::sin(tilt_pixel);
+      bool visible = false;
+      for (int x = 0; x < width; ++x) {
+	weight[x] = 0.0f;
+	red[x] = green[x] = blue[x] = 0.0f;
+	const double direction[3] = {cos_tilt * sin_pan[x], sin_tilt, cos_tilt * cos_pan[x]};
+	const double depth = direction[0] * forward[0] + direction[1] * forward[1] + direction[2] * forward[2];
+	if (depth <= 1e-6)
+	  continue;
+	const double u = center_x + focal_x * (direction[0] * right[0] + direction[2] * right[2]) / depth - 0.5;
+	const double v = center_y - focal_y * (direction[0] * up[0] + direction[1] * up[1] + direction[2] * up[2]) / depth - 0.5;
+	if ((u < 0.0) || (v < 0.0) || (u > image_width - 1) || (v > image_height - 1))
+	  continue;
+	// Bilinear sample
+	const int u0 = static_cast<int> (u);
+	const int v0 = static_cast<int> (v);
+	const int u1 = std::min(u0 + 1, image_width - 1);
+	const int v1 = std::min(v0 + 1, image_height - 1);
+	const float fu = static_cast<float> (u - u0);
+	const float fv = static_cast<float> (v - v0);
+	const quint32* line0 = reinterpret_cast<const quint32*> (image.constScanLine(v0));
+	const quint32* line1 = reinterpret_cast<const quint32*> (image.constScanLine(v1));
+	const quint32 p00 = line0[u0], p01 = line0[u1], p10 = line1[u0], p11 = line1[u1];
+	const float w00 = (1.0f - fu) * (1.0f - fv), w01 = fu * (1.0f - fv), w10 = (1.0f - fu) * fv, w11 = fu * fv;
+	red[x] = w00 * ((p00 >> 16) & 0xFF) + w01 * ((p01 >> 16) & 0xFF) + w10 * ((p10 >> 16) & 0xFF) + w11 * ((p11 >> 16) & 0xFF);
+	green[x] = w00 * ((p00 >> 8) & 0xFF) + w01 * ((p01 >> 8) & 0xFF) + w10 * ((p10 >> 8) & 0xFF) + w11 * ((p11 >> 8) & 0xFF);
+	blue[x] = w00 * (p00 & 0xFF) + w01 * (p01 & 0xFF) + w10 * (p10 & 0xFF) + w11 * (p11 & 0xFF);
+	// Feathering, 1 at the center and 0 at the borders
+	const double border_x = std::min(u + 0.5, image_width - u - 0.5) / center_x;
+	const double border_y = std::min(v + 0.5, image_height - v - 0.5) / center_y;
+	weight[x] = zoom_weight * static_cast<float> (border_x * border_y) + 1e-6f;
+	visible = true;
+      }
+      if (visible)
+	accumulate_row(sum_red + y * size, sum_green + y * size, sum_blue + y * size, sum_weight + y * size, red, green, blue, weight, width);
+    }
+  }
+
+  QImage tile(width, height, QImage::Format_RGB32);
+  for (int y = 0; y < height; ++y)
+    normalize_row(sum_red + y * size, sum_green + y * size, sum_blue + y * size, sum_weight + y * size, reinterpret_cast<quint32*> (tile.scanLine(y)), width);
+  if (!tile.save(tile_filename(row, column), "JPEG", jpeg_quality)) {
+    std::cout << "Error while writting the tile " << row << "-" << column << " !!!" << std::endl;
+    QMutexLocker locker(&mutex);
+    failed_tiles.append(_tile);
+    return;
+  }
+  ++tiles_written;
+}
+
+// Accumulate the weighted samples of a row - 4 pixels at a time with SSE2
+void PanoramaBuilder::accumulate_row(float* _red, float* _green, float* _blue, float* _weight, const float* _sample_red, const float* _sample_green, const float* _sample_blue, const float* _sample_weight, const int _size) {
+  int i = 0;
+#ifdef __SSE2__
+  for (; i + 4 <= _size; i += 4) {
+    const __m128 weight = _mm_loadu_ps(_sample_weight + i);
+    _mm_storeu_ps(_red + i, _mm_add_ps(_mm_loadu_ps(_red + i), _mm_mul_ps(_mm_loadu_ps(_sample_red + i), weight)));
+    _mm_storeu_ps(_green + i, _mm_add_ps(_mm_loadu_ps(_green + i), _mm_mul_ps(_mm_loadu_ps(_sample_green + i), weight)));
+    _mm_storeu_ps(_blue + i, _mm_add_ps(_mm_loadu_ps(_blue + i), _mm_mul_ps(_mm_loadu_ps(_sample_blue + i), weight)));
+    _mm_storeu_ps(_weight + i, _mm_add_ps(_mm_loadu_ps(_weight + i), weight));
+  }
+#endif
+  for (; i < _size; ++i) {
+    _red[i] += _sample_red[i] * _sample_weight[i];
+    _green[i] += _sample_green[i] * _sample_weight[i];
+    _blue[i] += _sample_blue[i] * _sample_weight[i];
+    _weight[i] += _sample_weight[i];
+  }
+}
+
+// Divide the sums by the weights into RGB32 pixels - 4 pixels at a time
+// with SSE2
+void PanoramaBuilder::normalize_row(const float* _red, const float* _green, const float* _blue, const float* _weight, quint32* _pixels, const int _size) {
+  int i = 0;
+#ifdef __SSE2__
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 top = _mm_set1_ps(255.0f);
+  const __m128i alpha = _mm_set1_epi32(static_cast<int> (0xFF000000u));
+  for (; i + 4 <= _size; i += 4) {
+    const __m128 weight = _mm_loadu_ps(_weight + i);
+    // 0 where there is no weight
+    const __m128 inverse = _mm_and_ps(_mm_div_ps(one, _mm_max_ps(weight, _mm_set1_ps(1e-12f))), _mm_cmpgt_ps(weight, zero));
+    const __m128i red = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(_red + i), inverse), zero), top));
+    const __m128i green = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(_green + i), inverse), zero), top));
+    const __m128i blue = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(_blue + i), inverse), zero), top));
+    const __m128i pixels = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(red, 16)), _mm_or_si128(_mm_slli_epi32(green, 8), blue));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (_pixels + i), pixels);
+  }
+#endif
+  for (; i < _size; ++i) {
+    if (_weight[i] <= 0.0f) {
+      _pixels[i] = 0xFF000000u;
+      continue;
+    }
+    const float inverse = 1.0f / _weight[i];
+    const quint32 red = static_cast<quint32> (std::min(255.0f, std::max(0.0f, _red[i] * inverse)) + 0.5f);
+    const quint32 green = static_cast<quint32> (std::min(255.0f, std::max(0.0f, _green[i] * inverse)) + 0.5f);
+    const quint32 blue = static_cast<quint32> (std::min(255.0f, std::max(0.0f, _blue[i] * inverse)) + 0.5f);
+    _pixels[i] = 0xFF000000u | (red << 16) | (green << 8) | blue;
+  }
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PANORAMABUILDER_H_
+#define PANORAMABUILDER_H_
+
+// stl library
+#include <atomic>
+#include <vector>
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QDateTime>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QImage>
+#include <QRunnable>
+#include <QSharedPointer>
+
+#include "scanplanner.h"
+#include "spherearchive.h"
+
+// Equirectangular panorama of the frames of the sphere acquisitions. The
+// canvas spans 360 degrees of pan by 180 degrees of tilt and is cut in
+// square tiles, written as tile-<row>-<column>.jpg in the output directory.
+// A tile is rendered from the frames overlapping it only, so that the canvas
+// never sits in memory, and a frame added again - e.g. a pose captured once
+// more - only renders the tiles it overlaps again.
+class PanoramaBuilder : public QObject
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Side of the tiles in pixels, a multiple of 4 for the blending kernels
+  static const int tile_size = 256;
+
+  // Constructor - the height of the canvas is half its width
+  explicit PanoramaBuilder(const QString& _output_directory, const int _canvas_width = 8192, QObject *parent = 0);
+
+  /* Frame management */
+  // The frames are placed from their pose, the field of view is the one of
+  // their zoom - see ScanPlanner. A frame taken at the pose of a previous
+  // one replaces it when it is more recent.
+  // Add the images of a sphere directory - returns the number of frames
+  int add_directory(const QString& _directory);
+  // Add the frames of a sphere archive - returns the number of frames
+  int add_archive(const QString& _filename);
+  // Add an image named as by the acquisitions:
+  // <tilt>-<pan>-<zoom>-<focus>-<time>.jpg
+  bool add_image(const QString& _filename);
+  inline int size() const { return static_cast<int> (frames.size()); }
+
+  /* Rendering */
+  // Render the tiles overlapped by the frames added since the last call on
+  // _thread_count threads, 0 for one per core. Returns the number of tiles
+  // written. The frames must not be added meanwhile.
+  int render(const int _thread_count = 0);
+  inline int get_dirty_tiles() const { return dirty_tiles.size(); }
+  inline int get_canvas_width() const { return canvas_width; }
+  inline int get_canvas_height() const { return canvas_height; }
+  // Memory given to the decoded frames shared by the tiles
+  inline void set_max_decoded_bytes(const qint64 _bytes) { max_decoded_bytes = _bytes; }
+  QString tile_filename(const int _row, const int _column) const;
+
+  // Blending kernels - accumulate the weighted samples of a row, and divide
+  // the sums by the weights into RGB32 pixels, black without weight
+  static void accumulate_row(float* _red, float* _green, float* _blue, float* _weight, const float* _sample_red, const float* _sample_green, const float* _sample_blue, const float* _sample_weight, const int _size);
+  static void normalize_row(const float* _red, const float* _green, const float* _blue, const float* _weight, quint32* _pixels, const int _size);
+
+public slots:
+  // slot to follow a running acquisition stored in a directory - connect
+  // the image_grabbed() signal of the camera, then render() from time to time
+  void image_grabbed(const quint64 _request_id, const QString& _filename);
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  // Frame with its bounding box on the canvas in degrees, the pan range can
+  // go past -180 or 180 and wraps around
+  struct PanoramaFrame {
+    ScanPose pose;
+    // Time of the acquisition in UTC, for the most recent frame - invalid
+    // when unknown
+    QDateTime time;
+    // Image file, or frame of an archive
+    QString filename;
+    QSharedPointer<SphereArchiveReader> archive;
+    int archive_index;
+    double pan_min;
+    double pan_max;
+    double tilt_min;
+    double tilt_max;
+  };
+  std::vector<PanoramaFrame> frames;
+  // Index of the frame of each pose
+  QHash<quint64, int> pose_index;
+
+  // Private members regarding the canvas
+  QString output_directory;
+  int canvas_width;
+  int canvas_height;
+  int tile_columns;
+  int tile_rows;
+  static const int jpeg_quality = 90;
+  // Tiles to render, row * tile_columns + column
+  QSet<int> dirty_tiles;
+
+  // Private members regarding the decoded frames, protected by the mutex
+  QMutex mutex;
+  QHash<int, QImage> decoded;
+  // Least recently used first
+  QList<int> decoded_order;
+  qint64 decoded_bytes;
+  qint64 max_decoded_bytes;
+  static const qint64 default_max_decoded_bytes = 256 * 1024 * 1024;
+  // Tiles which could not be written, rendered again next time
+  QList<int> failed_tiles;
+  std::atomic<int> tiles_written;
+
+  // Tile rendered on the thread pool
+  class TileTask : public QRunnable
+  {
+  public:
+    TileTask(PanoramaBuilder* _builder, const int _tile) : builder(_builder), tile(_tile) {}
+    void run() { builder->render_tile(tile); }
+  private:
+    PanoramaBuilder* builder;
+    int tile;
+  };
+
+  // Add or replace a frame and mark its tiles to render
+  bool add_frame(PanoramaFrame& _frame);
+  void mark_dirty(const PanoramaFrame& _frame);
+  static bool overlaps(const PanoramaFrame& _frame, const double _pan_min, const double _pan_max, const double _tilt_min, const double _tilt_max);
+  // Decoded frame, shared by the tiles through the cache
+  QImage frame_image(const int _index);
+  void forget_image(const int _index);
+  // Decode a frame no larger than its footprint on the canvas
+  QImage decode(const PanoramaFrame& _frame) const;
+  // Project the frames overlapping a tile and write it
+  void render_tile(const int _tile);
+
+  PanoramaBuilder(const PanoramaBuilder&);
+  PanoramaBuilder& operator=(const PanoramaBuilder&);
+};
+
+#endif  // PANORAMABUILDER_H_
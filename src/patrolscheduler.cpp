@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "patrolscheduler.h"
+
+// stl library
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+PatrolScheduler::PatrolScheduler(SonySNCRX550N* _camera, QObject *parent) :
+  QObject(parent), camera(_camera), running(false), speed(24), lookahead(default_lookahead),
+  holding(false), visiting(-1), visit_start(0), visit_move_time(0), first_capture(0), capture_time(default_capture_time) {
+  wake_timer.setSingleShot(true);
+  connect(&wake_timer, SIGNAL(timeout()), this, SLOT(end_hold()));
+  connect(camera, SIGNAL(request_finished(quint64, bool)), this, SLOT(request_finished(quint64, bool)));
+}
+
+// Add a pose to the patrol
+bool PatrolScheduler::add_point(const QString& _name, const ScanPose& _pose, const double _revisit_interval, const int _captures, const double _dwell) {
+  if (find_point(_name) != -1) {
+    std::cout << "The patrol has already a pose with this name !!! The pose is not added !!!" << std::endl;
+    return false;
+  }
+  if ((_revisit_interval <= 0.0) || (_captures < 1) || (_dwell < 0.0)) {
+    std::cout << "The revisit interval, captures or dwell requested is out of range !!! The pose is not added !!!" << std::endl;
+    return false;
+  }
+  if ((PtzCodec::zoom_code(_pose.zoom) == PtzCodec::invalid_code) || (PtzCodec::focus_code(_pose.focus) == PtzCodec::invalid_code)) {
+    std::cout << "The zoom or focus requested is unknown !!! The pose is not added !!!" << std::endl;
+    return false;
+  }
+  PatrolState state;
+  state.point.name = _name;
+  state.point.pose = _pose;
+  state.point.revisit_interval = _revisit_interval;
+  state.point.captures = _captures;
+  state.point.dwell = _dwell;
+  state.visited = false;
+  // A new pose is due within its interval
+  state.deadline = (running ? now() : 0.0) + _revisit_interval;
+  state.first_visit = 0;
+  state.last_visit = 0;
+  state.statistics = PatrolStatistics();
+  points.append(state);
+  // The patrol may be waiting for the next pose, a hold goes on
+  if (running && (visiting == -1) && (!holding))
+    schedule_next();
+  return true;
+}
+
+// Remove a pose from the patrol, its visit in progress ends with no record
+bool PatrolScheduler::remove_point(const QString& _name) {
+  const int index = find_point(_name);
+  if (index == -1)
+    return false;
+  points.removeAt(index);
+  if (visiting == index) {
+    visiting = -1;
+    pending_images.clear();
+    if (running)
+      schedule_next();
+  }
+  else if (visiting > index)
+    --visiting;
+  return true;
+}
+
+// Start the patrol from the current position of the camera
+void PatrolScheduler::start(const long _speed) {
+  speed = _speed;
+  camera->get_camera_positions(position.pan, position.tilt, position.zoom, position.focus);
+  clock.start();
+  for (int i = 0; i < points.size(); ++i) {
+    PatrolState& state = points[i];
+    state.visited = false;
+    state.deadline = state.point.revisit_interval;
+    state.statistics = PatrolStatistics();
+  }
+  holding = false;
+  visiting = -1;
+  pending_images.clear();
+  running = true;
+  schedule_next();
+}
+
+// Stop after the requests already sent
+void PatrolScheduler::stop() {
+  running = false;
+  wake_timer.stop();
+  holding = false;
+  visiting = -1;
+  pending_images.clear();
+}
+
+// Statistics of a pose, zero when unknown
+PatrolStatistics PatrolScheduler::get_statistics(const QString& _name) const {
+  const int index = find_point(_name);
+  return (index == -1) ? PatrolStatistics() : points.at(index).statistics;
+}
+
+// Print the statistics of every pose
+void PatrolScheduler::print_report() const {
+  for (int i = 0; i < points.size(); ++i) {
+    const PatrolState& state = points.at(i);
+    const PatrolStatistics& statistics = state.statistics;
+    std::cout << state.point.name.toStdString() << " - visits = " << statistics.visits << " - missed = " << statistics.misses
+	      << " - failed = " << statistics.failures
+	      << " - revisit interval = " << statistics.mean_revisit_interval << " s (max = " << statistics.max_revisit_interval
+	      << " s, target = " << state.point.revisit_interval << " s) - max lateness = " << statistics.max_lateness << " s" << std::endl;
+  }
+}
+
+// Index of a pose from its name
+int PatrolScheduler::find_point(const QString& _name) const {
+  for (int i = 0; i < points.size(); ++i)
+    if (points.at(i).point.name == _name)
+      return i;
+  return -1;
+}
+
+// Index of the next pose to visit - the cheapest candidate which lets the
+// most urgent one make its deadline, otherwise the most urgent one
+int PatrolScheduler::choose_next(const double _now) const {
+  const ScanPlanner& planner = camera->get_scan_planner();
+  int urgent = -1;
+  for (int i = 0; i < points.size(); ++i) {
+    const PatrolState& state = points.at(i);
+    if (state.visited && (state.deadline - _now > lookahead))
+      continue;
+    if ((urgent == -1) || (state.deadline < points.at(urgent).deadline))
+      urgent = i;
+  }
+  if (urgent == -1)
+    return -1;
+  const PatrolState& target = points.at(urgent);
+  int best = urgent;
+  double best_cost = planner.move_time(position, target.point.pose, speed);
+  for (int i = 0; i < points.size(); ++i) {
+    const PatrolState& state = points.at(i);
+    if ((i == urgent) || (state.visited && (state.deadline - _now > lookahead)))
+      continue;
+    const double cost = planner.move_time(position, state.point.pose, speed);
+    if (cost >= best_cost)
+      continue;
+    // The detour has to leave the most urgent pose on time
+    const double arrival = _now + cost + service_time(state.point) + planner.move_time(state.point.pose, target.point.pose, speed);
+    if (arrival <= target.deadline) {
+      best = i;
+      best_cost = cost;
+    }
+  }
+  return best;
+}
+
+// slot to start the next visit, or to wait until one is due
+void PatrolScheduler::schedule_next() {
+  if ((!running) || (visiting != -1) || holding || points.isEmpty())
+    return;
+  const double time = now();
+  const int index = choose_next(time);
+  if (index != -1) {
+    wake_timer.stop();
+    visit(index);
+    return;
+  }
+  // Sleep until the earliest deadline enters the lookahead
+  double earliest = points.at(0).deadline;
+  for (int i = 1; i < points.size(); ++i)
+    earliest = std::min(earliest, points.at(i).deadline);
+  const double wait = earliest - lookahead - time;
+  wake_timer.start((wait > 0.0) ? static_cast<int> (std::ceil(wait * 1000.0)) : 0);
+}
+
+// slot to end a hold and schedule the next visit
+void PatrolScheduler::end_hold() {
+  holding = false;
+  schedule_next();
+}
+
+// Move to a pose and grab its images
+void PatrolScheduler::visit(const int _index) {
+  const PatrolPoint& point = points.at(_index).point;
+  visiting = _index;
+  visit_start = now();
+  visit_move_time = camera->get_scan_planner().move_time(position, point.pose, speed);
+  first_capture = -1.0;
+  // The zoom and the focus are only sent when they change
+  if ((point.pose.zoom != position.zoom) || (point.pose.focus != position.focus))
+    camera->absolute_pose(point.pose.pan, point.pose.tilt, point.pose.zoom, point.pose.focus, speed);
+  else
+    camera->absolute_motion(point.pose.pan, point.pose.tilt, speed);
+  position = point.pose;
+  // The images are gated on the settling of the head
+  for (int i = 0; i < point.captures; ++i) {
+    const quint64 request_id = camera->grab_image();
+    if (request_id != 0)
+      pending_images.insert(request_id);
+  }
+  if (pending_images.isEmpty())
+    finish_visit();
+}
+
+// slot to follow the images of the visit in progress
+void PatrolScheduler::request_finished(const quint64 _request_id, const bool _success) {
+  if (!pending_images.remove(_request_id))
+    return;
+  if (_success && (first_capture < 0.0))
+    first_capture = now();
+  if (pending_images.isEmpty())
+    finish_visit();
+}
+
+// Record the visit in progress once its images are done
+void PatrolScheduler::finish_visit() {
+  PatrolState& state = points[visiting];
+  const double time = now();
+  visiting = -1;
+  if (first_capture < 0.0) {
+    // No image, the pose stays due but is only visited again after a
+    // back off, the camera would otherwise be asked for it in a loop
+    ++state.statistics.failures;
+    std::cout << "No image of the patrol pose " << state.point.name.toStdString() << " !!! The visit is not counted !!!" << std::endl;
+    const double backoff = std::max(capture_time, lookahead);
+    holding = true;
+    wake_timer.start(static_cast<int> (std::ceil(backoff * 1000.0)));
+    return;
+  }
+  // Learn the time of a capture, move excluded
+  const double measured = std::max(0.0, (time - visit_start - visit_move_time) / state.point.captures);
+  capture_time = 0.8 * capture_time + 0.2 * measured;
+  // Record the visit at its first image
+  PatrolStatistics& statistics = state.statistics;
+  const double lateness = first_capture - state.deadline;
+  if (state.visited) {
+    const double interval = first_capture - state.last_visit;
+    statistics.max_revisit_interval = std::max(statistics.max_revisit_interval, interval);
+  }
+  else
+    state.first_visit = first_capture;
+  ++statistics.visits;
+  if (statistics.visits > 1)
+    statistics.mean_revisit_interval = (first_capture - state.first_visit) / (statistics.visits - 1);
+  if (lateness > 0.0) {
+    ++statistics.misses;
+    statistics.total_lateness += lateness;
+    statistics.max_lateness = std::max(statistics.max_lateness, lateness);
+  }
+  state.visited = true;
+  state.last_visit = first_capture;
+  state.deadline = first_capture + state.point.revisit_interval;
+  // Stay at the pose for the rest of the dwell
+  const double dwell_left = state.point.dwell - (time - first_capture);
+  holding = true;
+  wake_timer.start((dwell_left > 0.0) ? static_cast<int> (std::ceil(dwell_left * 1000.0)) : 0);
+  // The receivers may change the patrol
+  const QString name = state.point.name;
+  emit visit_done(name, lateness);
+  if (lateness > 0.0)
+    emit deadline_missed(name, lateness);
+}
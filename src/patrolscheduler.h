@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PATROLSCHEDULER_H_
+#define PATROLSCHEDULER_H_
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "scanplanner.h"
+#include "sonysncrx550n.h"
+
+// Pose of a patrol, visited again every revisit_interval seconds
+struct PatrolPoint {
+  QString name;
+  ScanPose pose;
+  double revisit_interval;
+  // Images grabbed at each visit, and minimum time spent at the pose from
+  // the first image, in seconds
+  int captures;
+  double dwell;
+};
+
+// Visits of a pose since the start of the patrol, the times are in seconds
+struct PatrolStatistics {
+  quint64 visits;
+  // Visits done after their deadline, and by how much
+  quint64 misses;
+  double total_lateness;
+  double max_lateness;
+  // Visits which got no image, the pose stays due
+  quint64 failures;
+  // Achieved time between two visits
+  double mean_revisit_interval;
+  double max_revisit_interval;
+};
+
+// Recurring tour over named poses. A pose is due once its revisit interval
+// has elapsed since its previous visit, which sets its deadline. The next
+// pose is chosen at runtime:
+//   - the candidates are the poses never visited and the ones whose deadline
+//     is within the lookahead
+//   - the cheapest candidate to reach is visited first as long as the most
+//     urgent one still makes its deadline afterwards, otherwise the most
+//     urgent one is visited - earliest deadline first
+// The images are stored as by the other acquisitions of the camera.
+class PatrolScheduler : public QObject
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - the camera is driven through its absolute motions, it
+  // should not be given other commands while the patrol runs
+  explicit PatrolScheduler(SonySNCRX550N* _camera, QObject *parent = 0);
+
+  /* Patrol management */
+  // Add a pose - false when the name is taken or the values are out of range
+  // _revisit_interval: seconds between two visits | > 0
+  // _captures: images per visit                   | >= 1
+  // _dwell: seconds spent at the pose             | >= 0
+  bool add_point(const QString& _name, const ScanPose& _pose, const double _revisit_interval, const int _captures = 1, const double _dwell = 0.0);
+  bool remove_point(const QString& _name);
+  inline int size() const { return points.size(); }
+  // How early before its deadline a pose can be visited, in seconds
+  inline void set_lookahead(const double _lookahead) { lookahead = (_lookahead < 0.0) ? 0.0 : _lookahead; }
+  inline double get_lookahead() const { return lookahead; }
+
+  // Start the patrol from the current position of the camera, the
+  // statistics start again
+  void start(const long _speed = 24);
+  // Stop after the requests already sent
+  void stop();
+  inline bool is_running() const { return running; }
+
+  /* Statistics */
+  PatrolStatistics get_statistics(const QString& _name) const;
+  // Print the statistics of every pose on the console
+  void print_report() const;
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  SonySNCRX550N* camera;
+
+  // Pose with its schedule and its statistics
+  struct PatrolState {
+    PatrolPoint point;
+    bool visited;
+    double deadline;
+    double first_visit;
+    double last_visit;
+    PatrolStatistics statistics;
+  };
+  QList<PatrolState> points;
+
+  // Private members regarding the patrol
+  bool running;
+  long speed;
+  double lookahead;
+  static constexpr double default_lookahead = 5.0;
+  // Clock of the patrol, in seconds since start()
+  QElapsedTimer clock;
+  inline double now() const { return clock.nsecsElapsed() / 1e9; }
+  // Wake up at the end of a hold or when the next pose is due
+  QTimer wake_timer;
+  // The head is held at a pose, for the rest of a dwell or before visiting
+  // again a pose which got no image, no visit starts until the hold ends
+  bool holding;
+  // Position of the head once the requests sent are done
+  ScanPose position;
+
+  // Private members regarding the visit in progress, -1 when none
+  int visiting;
+  QSet<quint64> pending_images;
+  double visit_start;
+  double visit_move_time;
+  double first_capture;
+  // Time of a capture, measured from the visits and used to predict them
+  double capture_time;
+  static constexpr double default_capture_time = 0.5;
+
+  // Index of a pose from its name, -1 if unknown
+  int find_point(const QString& _name) const;
+  // Index of the next pose to visit, -1 if none is due within the lookahead
+  int choose_next(const double _now) const;
+  // Predicted time spent at a pose
+  inline double service_time(const PatrolPoint& _point) const { return _point.captures * capture_time + _point.dwell; }
+  // Move to a pose and grab its images
+  void visit(const int _index);
+  // Record the visit in progress once its images are done
+  void finish_visit();
+
+private slots:
+  // slot to start the next visit, or to wait until one is due
+  void schedule_next();
+  // slot to end a hold and schedule the next visit
+  void end_hold();
+  // slot to follow the images of the visit in progress
+  void request_finished(const quint64 _request_id, const bool _success);
+
+signals:
+  // Emitted after each visit, _lateness is the time past the deadline in
+  // seconds - negative when the visit is on time
+  void visit_done(const QString& _name, const double _lateness);
+  // Emitted when a visit misses its deadline
+  void deadline_missed(const QString& _name, const double _lateness);
+};
+
+#endif  // PATROLSCHEDULER_H_
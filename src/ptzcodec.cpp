@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "ptzcodec.h"
+
+// qt library
+#include <QLatin1String>
+
+// stl library
+#include <cstring>
+
+// Name of a zoom or focus position and its code
+struct PositionCode {
+  const char* key;
+  quint16 code;
+};
+
+// Tables of the zoom and focus positions, built at compile time
+static constexpr PositionCode zoom_positions[] = {
+  {"oz-1", 0x0000}, {"oz-2", 0x1760}, {"oz-3", 0x214C}, {"oz-4", 0x2722}, {"oz-5", 0x2B22}, {"oz-6", 0x2E20}, {"oz-7", 0x3080}, {"oz-8", 0x3278}, {"oz-9", 0x3426},
+  {"oz-10", 0x359E}, {"oz-11", 0x36EE}, {"oz-12", 0x381C}, {"oz-13", 0x392E}, {"oz-14", 0x3A26}, {"oz-15", 0x3B08}, {"oz-16", 0x3BD4}, {"oz-17", 0x3C8C},
+  {"oz-18", 0x3D2E}, {"oz-19", 0x3DBC}, {"oz-20", 0x3E58}, {"oz-21", 0x3EA2}, {"oz-22", 0x3F00}, {"oz-23", 0x3F4E}, {"oz-24", 0x3F92}, {"oz-25", 0x3FCC},
+  {"dz-1", 0x4000}, {"dz-2", 0x6000}, {"dz-3", 0x6A80}, {"dz-4", 0x7000}, {"dz-5", 0x7300}, {"dz-6", 0x7540}, {"dz-7", 0x76C0}, {"dz-8", 0x7800}, {"dz-9", 0x78C0},
+  {"dz-10", 0x7980}, {"dz-11", 0x7A00}, {"dz-12", 0x7AC0}
+};
+static constexpr PositionCode focus_positions[] = {
+  {"f-inf", 0x1000}, {"f-7200", 0x2000}, {"f-3300", 0x3000}, {"f-2000", 0x4000}, {"f-1300", 0x5000}, {"f-1000", 0x6000},
+  {"f-800", 0x7000}, {"f-400", 0x8000}, {"f-200", 0x9000}, {"f-110", 0xA000}, {"f-60", 0xB000}, {"f-35", 0xC000}
+};
+static constexpr int zoom_position_count = sizeof(zoom_positions) / sizeof(PositionCode);
+static constexpr int focus_position_count = sizeof(focus_positions) / sizeof(PositionCode);
+
+// The codes are unique and the keys short, a linear search is enough
+static quint16 find_code(const PositionCode* _table, const int _count, const QString& _key) {
+  for (int i = 0; i < _count; ++i)
+    if (_key == QLatin1String(_table[i].key))
+      return _table[i].code;
+  return PtzCodec::invalid_code;
+}
+
+static const char* find_key(const PositionCode* _table, const int _count, const quint16 _code) {
+  for (int i = 0; i < _count; ++i)
+    if (_table[i].code == _code)
+      return _table[i].key;
+  return 0;
+}
+
+quint16 PtzCodec::zoom_code(const QString& _zoom_position) {
+  return find_code(zoom_positions, zoom_position_count, _zoom_position);
+}
+
+quint16 PtzCodec::focus_code(const QString& _focus_position) {
+  return find_code(focus_positions, focus_position_count, _focus_position);
+}
+
+const char* PtzCodec::zoom_key(const quint16 _zoom_code) {
+  return find_key(zoom_positions, zoom_position_count, _zoom_code);
+}
+
+const char* PtzCodec::focus_key(const quint16 _focus_code) {
+  return find_key(focus_positions, focus_position_count, _focus_code);
+}
+
+// Value of an hexadecimal digit, -1 if the character is not one
+static inline int hex_digit(const int _c) {
+  if ((_c >= '0') && (_c <= '9'))
+    return _c - '0';
+  if ((_c >= 'A') && (_c <= 'F'))
+    return _c - 'A' + 10;
+  if ((_c >= 'a') && (_c <= 'f'))
+    return _c - 'a' + 10;
+  return -1;
+}
+
+// Read a code of 1 to 4 digits, possibly preceded by '-'
+bool PtzCodec::parse_code(const char* _text, const int _length, quint16& _code) {
+  const bool negative = (_length > 0) && (_text[0] == '-');
+  const int first = negative ? 1 : 0;
+  if ((_length - first < 1) || (_length - first > 4))
+    return false;
+  int value = 0;
+  for (int i = first; i < _length; ++i) {
+    const int digit = hex_digit(_text[i]);
+    if (digit < 0)
+      return false;
+    value = (value << 4) | digit;
+  }
+  _code = static_cast<quint16> (negative ? -value : value);
+  return true;
+}
+
+bool PtzCodec::parse_code(const QString& _text, quint16& _code) {
+  char text[5];
+  const int length = _text.size();
+  if (length > 5)
+    return false;
+  for (int i = 0; i < length; ++i) {
+    const ushort c = _text.at(i).unicode();
+    text[i] = (c < 0x80) ? static_cast<char> (c) : '?';
+  }
+  return parse_code(text, length, _code);
+}
+
+// Read the AbsolutePTZF=<pan>,<tilt>,<zoom>,<focus> item of an answer
+bool PtzCodec::parse_ptzf(const QByteArray& _answer, PtzPose& _pose) {
+  static const char item[] = "AbsolutePTZF=";
+  const int start = _answer.indexOf(item);
+  if (start < 0)
+    return false;
+  const char* text = _answer.constData();
+  const int end = _answer.size();
+  int position = start + static_cast<int> (std::strlen(item));
+  quint16 codes[4];
+  for (int i = 0; i < 4; ++i) {
+    int length = 0;
+    while ((position + length < end) && (hex_digit(text[position + length]) >= 0 || text[position + length] == '-'))
+      ++length;
+    if (!parse_code(text + position, length, codes[i]))
+      return false;
+    position += length;
+    // The axes are separated by commas
+    if (i < 3) {
+      if ((position >= end) || (text[position] != ','))
+	return false;
+      ++position;
+    }
+  }
+  _pose.pan_steps = code_to_steps(codes[0]);
+  _pose.tilt_steps = code_to_steps(codes[1]);
+  _pose.zoom_code = codes[2];
+  _pose.focus_code = codes[3];
+  return true;
+}
+
+// Write the query of a command, replacing the previous one
+void PtzQueryEncoder::encode(const PtzCommand& _command) {
+  length = 0;
+  if (_command.axes & PtzCommand::pan_tilt_axis) {
+    append(_command.relative ? "relativepantilt=" : "absolutepantilt=");
+    append_code(static_cast<quint16> (_command.pose.pan_steps));
+    append(",");
+    append_code(static_cast<quint16> (_command.pose.tilt_steps));
+    append(",");
+    append_number(_command.speed);
+  }
+  if (_command.axes & PtzCommand::zoom_axis) {
+    append((length > 0) ? "&absolutezoom=" : "absolutezoom=");
+    append_code(_command.pose.zoom_code);
+  }
+  if (_command.axes & PtzCommand::focus_axis) {
+    append((length > 0) ? "&absolutefocus=" : "absolutefocus=");
+    append_code(_command.pose.focus_code);
+  }
+  buffer[length] = '\0';
+}
+
+void PtzQueryEncoder::append(const char* _text) {
+  while ((*_text != '\0') && (length < capacity - 1))
+    buffer[length++] = *_text++;
+}
+
+void PtzQueryEncoder::append_code(const quint16 _code) {
+  if (length + 4 >= capacity)
+    return;
+  PtzCodec::write_code(buffer + length, _code);
+  length += 4;
+}
+
+// Speed of the motion - 1 to 24
+void PtzQueryEncoder::append_number(const int _value) {
+  char digits[12];
+  int count = 0;
+  unsigned int value = (_value < 0) ? 0 : static_cast<unsigned int> (_value);
+  do {
+    digits[count++] = static_cast<char> ('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  while ((count > 0) && (length < capacity - 1))
+    buffer[length++] = digits[--count];
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PTZCODEC_H_
+#define PTZCODEC_H_
+
+// stl library
+#include <cmath>
+
+// qt library
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+
+// Position of the head in motor steps and lens codes, as sent to the camera
+struct PtzPose {
+  qint32 pan_steps;
+  qint32 tilt_steps;
+  quint16 zoom_code;
+  quint16 focus_code;
+};
+
+// Command sent through ptzf.cgi - only the axes flagged are moved. For a
+// relative motion the steps are an offset from the current position.
+struct PtzCommand {
+  enum Axis { pan_tilt_axis = 1, zoom_axis = 2, focus_axis = 4 };
+
+  PtzCommand() : axes(0), relative(false), speed(0) {
+    pose.pan_steps = 0;
+    pose.tilt_steps = 0;
+    pose.zoom_code = 0;
+    pose.focus_code = 0;
+  }
+
+  int axes;
+  bool relative;
+  PtzPose pose;
+  int speed;
+};
+
+// Conversions between the angles, the zoom and focus positions and the codes
+// of the camera. None of them allocates memory.
+class PtzCodec
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Motor steps of the axes
+  static constexpr qint32 pan_steps = 16320;
+  static constexpr double pan_angle = 360.0;
+  static constexpr qint32 tilt_steps = 4352;
+  static constexpr double tilt_angle = 96.0;
+  // Code of an unknown zoom or focus position
+  static constexpr quint16 invalid_code = 0xFFFF;
+  // Speeds of the pan and tilt motions
+  static constexpr int min_speed = 1;
+  static constexpr int max_speed = 24;
+
+  /* Angles */
+  static inline qint32 pan_to_steps(const double _angle) { return static_cast<qint32> (std::round(_angle * pan_steps / pan_angle)); }
+  static inline qint32 tilt_to_steps(const double _angle) { return static_cast<qint32> (std::round(_angle * tilt_steps / tilt_angle)); }
+  static inline double steps_to_pan(const qint32 _steps) { return _steps * pan_angle / pan_steps; }
+  static inline double steps_to_tilt(const qint32 _steps) { return _steps * tilt_angle / tilt_steps; }
+
+  /* Zoom and focus */
+  // The positions are named:
+  //   - optical zoom - oz-{1 ... 25}
+  //   - digital zoom - dz-{1 ... 12}
+  //   - focus - f-{inf ... 35} in mm
+  // An unknown position gives invalid_code, an unknown code 0
+  static quint16 zoom_code(const QString& _zoom_position);
+  static quint16 focus_code(const QString& _focus_position);
+  static const char* zoom_key(const quint16 _zoom_code);
+  static const char* focus_key(const quint16 _focus_code);
+
+  /* Hexadecimal codes */
+  // Write the 4 upper case digits of a code, the steps below 0 are given in
+  // two's complement
+  static inline void write_code(char* _out, const quint16 _code) {
+    static const char digits[] = "0123456789ABCDEF";
+    _out[0] = digits[(_code >> 12) & 0xF];
+    _out[1] = digits[(_code >> 8) & 0xF];
+    _out[2] = digits[(_code >> 4) & 0xF];
+    _out[3] = digits[_code & 0xF];
+  }
+  // Read a code of 1 to 4 digits, in either case, possibly preceded by '-'
+  static bool parse_code(const char* _text, const int _length, quint16& _code);
+  static bool parse_code(const QString& _text, quint16& _code);
+  // Steps given in two's complement
+  static inline qint32 code_to_steps(const quint16 _code) { return static_cast<qint16> (_code); }
+
+  // Read the AbsolutePTZF=<pan>,<tilt>,<zoom>,<focus> item of an answer of
+  // inquiry.cgi?inq=ptzf
+  static bool parse_ptzf(const QByteArray& _answer, PtzPose& _pose);
+
+  // Key of a pose, the steps are taken on 16 bits
+  static inline quint64 pose_key(const PtzPose& _pose) {
+    return (static_cast<quint64> (static_cast<quint16> (_pose.pan_steps)) << 48) | (static_cast<quint64> (static_cast<quint16> (_pose.tilt_steps)) << 32) |
+      (static_cast<quint64> (_pose.zoom_code) << 16) | static_cast<quint64> (_pose.focus_code);
+  }
+};
+
+// Query of a ptzf.cgi command, written in a fixed buffer:
+// [relativepantilt|absolutepantilt]=pppp,tttt,ss&absolutezoom=zzzz&absolutefocus=ffff
+class PtzQueryEncoder
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  PtzQueryEncoder() : length(0) { buffer[0] = '\0'; }
+
+  // Write the query of a command, replacing the previous one
+  void encode(const PtzCommand& _command);
+
+  inline const char* data() const { return buffer; }
+  inline int size() const { return length; }
+  // Copy of the query, e.g. for QUrl::setEncodedQuery()
+  inline QByteArray to_byte_array() const { return QByteArray(buffer, length); }
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  // Large enough for the longest query
+  static const int capacity = 96;
+  char buffer[capacity];
+  int length;
+
+  void append(const char* _text);
+  void append_code(const quint16 _code);
+  void append_number(const int _value);
+};
+
+#endif  // PTZCODEC_H_
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QList>
+#include <QThread>
+#include <QVector>
+
+#include "cameraworker.h"
+#include "mockcamera.h"
+#include "sonysncrx550n.h"
+
+#include <cmath>
+#include <iostream>
+
+// Producer of the queue, the commands carry their producer in the speed and
+// their rank in the pan steps
+class QueueProducer : public QThread
+{
+public:
+  QueueProducer(WorkerCommandQueue* _queue, const int _producer, const int _count) :
+    queue(_queue), producer(_producer), count(_count) {}
+protected:
+  void run() {
+    for (int i = 0; i < count; ++i) {
+      WorkerCommand* command = new WorkerCommand;
+      command->kind = WorkerCommand::move_command;
+      command->command.speed = producer;
+      command->command.pose.pan_steps = i;
+      queue->push(command);
+    }
+  }
+private:
+  WorkerCommandQueue* queue;
+  int producer;
+  int count;
+};
+
+// Several producers push while the consumer pops - every command comes out
+// once, in the order of its producer
+static bool test_queue_order(const int _producers, const int _count) {
+  WorkerCommandQueue queue;
+  QList<QueueProducer*> producers;
+  for (int i = 0; i < _producers; ++i)
+    producers.append(new QueueProducer(&queue, i, _count));
+  for (int i = 0; i < _producers; ++i)
+    producers.at(i)->start();
+  QVector<int> next_rank(_producers, 0);
+  int popped = 0;
+  bool success = true;
+  QElapsedTimer timer;
+  timer.start();
+  while ((popped < _producers * _count) && (timer.elapsed() < 10000)) {
+    WorkerCommand* command = queue.pop();
+    if (command == 0) {
+      QThread::yieldCurrentThread();
+      continue;
+    }
+    const int producer = command->command.speed;
+    if ((producer < 0) || (producer >= _producers) || (command->command.pose.pan_steps != next_rank[producer]))
+      success = false;
+    else
+      ++next_rank[producer];
+    ++popped;
+    delete command;
+  }
+  for (int i = 0; i < _producers; ++i) {
+    producers.at(i)->wait();
+    delete producers.at(i);
+  }
+  if (queue.pop() != 0)
+    success = false;
+  if ((!success) || (popped != _producers * _count)) {
+    std::cout << "The queue lost or reordered commands !!! " << popped << " popped out of " << _producers * _count << " !!!" << std::endl;
+    return false;
+  }
+  std::cout << "Queue order: " << popped << " commands of " << _producers << " producers popped in order" << std::endl;
+  return true;
+}
+
+// Queue a command of the camera on the worker queue
+static QFuture<bool> push_command(WorkerCommandQueue& _queue, const WorkerCommand::Kind _kind, const PtzCommand& _command) {
+  WorkerCommand* command = new WorkerCommand;
+  command->kind = _kind;
+  command->command = _command;
+  command->result.reportStarted();
+  QFuture<bool> future = command->result.future();
+  _queue.push(command);
+  return future;
+}
+
+// The absolute moves queued back to back are merged into the last one, the
+// axes it leaves alone keep the earlier targets and a settle barrier keeps
+// the moves around it apart
+static bool test_coalescing(const QString& _address) {
+  SonySNCRX550N camera(_address);
+  camera.set_verbose(false);
+  camera.wait_for_idle();
+  WorkerCommandQueue queue;
+  std::atomic<quint64> coalesced(0);
+  WorkerCommandRunner runner(&camera, &queue, &coalesced);
+  PtzCommand command;
+  QList<QFuture<bool> > futures;
+  SonySNCRX550N::make_absolute_motion(30.0, 10.0, 24, command);
+  futures.append(push_command(queue, WorkerCommand::move_command, command));
+  SonySNCRX550N::make_absolute_zoom("oz-4", command);
+  futures.append(push_command(queue, WorkerCommand::move_command, command));
+  futures.append(push_command(queue, WorkerCommand::settle_command, PtzCommand()));
+  SonySNCRX550N::make_absolute_motion(-20.0, 0.0, 24, command);
+  futures.append(push_command(queue, WorkerCommand::move_command, command));
+  SonySNCRX550N::make_absolute_motion(45.0, 5.0, 24, command);
+  futures.append(push_command(queue, WorkerCommand::move_command, command));
+  runner.drain();
+  QElapsedTimer timer;
+  timer.start();
+  bool finished = false;
+  while ((!finished) && (timer.elapsed() < 10000)) {
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    finished = true;
+    for (int i = 0; i < futures.size(); ++i)
+      finished = finished && futures.at(i).isFinished();
+  }
+  bool success = finished;
+  for (int i = 0; success && (i < futures.size()); ++i)
+    success = futures.at(i).result();
+  if ((!success) || (coalesced.load() != 2)) {
+    std::cout << "The moves were not merged as expected !!! " << coalesced.load() << " merged out of 2 !!!" << std::endl;
+    return false;
+  }
+  if ((std::fabs(camera.get_pan_position() - 45.0) > 0.1) || (std::fabs(camera.get_tilt_position() - 5.0) > 0.1) || (camera.get_zoom_position() != "oz-4")) {
+    std::cout << "The merged moves did not reach the last target !!! Pan = " << camera.get_pan_position() << " - Tilt = " << camera.get_tilt_position()
+	      << " - Zoom = " << camera.get_zoom_position().toStdString() << " !!!" << std::endl;
+    return false;
+  }
+  std::cout << "Coalescing: " << coalesced.load() << " moves merged, the camera reached the last target" << std::endl;
+  return true;
+}
+
+// Usage: queue_test
+// Checks the command queue of the camera worker - the order of the commands
+// pushed by several threads, and the merging of the moves against a mock
+// camera on localhost. Returns 0 when every check passed.
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+
+  MockSonySNCRX550N mock_cam;
+  MockCameraConfig config = MockSonySNCRX550N::default_config();
+  config.latency = 1;
+  mock_cam.set_config(config);
+  if (!mock_cam.listen(QHostAddress::LocalHost, 0)) {
+    std::cout << "The mock camera could not listen !!! Stopping the tests !!!" << std::endl;
+    return 1;
+  }
+
+  bool success = test_queue_order(4, 20000);
+  success = test_coalescing(mock_cam.get_address()) && success;
+  std::cout << (success ? "All tests passed" : "Some tests failed !!!") << std::endl;
+  return success ? 0 : 1;
+}
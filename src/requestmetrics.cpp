@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "requestmetrics.h"
+
+// qt library
+#include <QFile>
+
+// stl library
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+// Names of the metrics in the exports, in the order of RequestMetrics::Metric
+struct MetricDescription {
+  const char* key;
+  const char* help;
+  // The durations are exported in seconds and the sizes in bytes
+  bool duration;
+};
+static const MetricDescription metric_descriptions[RequestMetrics::metric_count] = {
+  { "queue", "Time spent by the requests in the queue", true },
+  { "first_byte", "Time from the sending of the requests to the first byte of the answer", true },
+  { "transfer", "Time from the first byte to the end of the answer", true },
+  { "received_bytes", "Size of the answers", false },
+  { "disk_write", "Time to write an image on the disk", true },
+  { "settle", "Time spent waiting for the head to stop", true }
+};
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+// Record a value, thread safe
+void LatencyHistogram::record(const quint64 _value) {
+  int index = 0;
+  while ((index < bucket_count - 1) && (_value > bucket_bound(index)))
+    ++index;
+  buckets[index].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(_value, std::memory_order_relaxed);
+  quint64 previous_max = max.load(std::memory_order_relaxed);
+  while ((_value > previous_max) && (!max.compare_exchange_weak(previous_max, _value, std::memory_order_relaxed)));
+}
+
+// Forget the recorded values
+void LatencyHistogram::reset() {
+  for (int i = 0; i < bucket_count; ++i)
+    buckets[i].store(0);
+  count.store(0);
+  sum.store(0);
+  max.store(0);
+}
+
+// Estimation of a percentile, by the nearest rank
+quint64 LatencyHistogram::percentile(const double _percent) const {
+  const quint64 total = get_count();
+  if (total == 0)
+    return 0;
+  quint64 rank = static_cast<quint64> (std::ceil(_percent / 100.0 * total));
+  if (rank < 1)
+    rank = 1;
+  quint64 seen = 0;
+  for (int i = 0; i < bucket_count; ++i) {
+    seen += get_bucket(i);
+    if (seen >= rank)
+      return (bucket_bound(i) < get_max()) ? bucket_bound(i) : get_max();
+  }
+  return get_max();
+}
+
+RequestMetrics::RequestMetrics(const QString& _name, QObject *parent) :
+  QObject(parent), name(_name), requests(0), failures(0),
+  retries(0), timeouts(0), reconnects(0), export_format(json_format) {
+  connect(&export_timer, SIGNAL(timeout()), this, SLOT(export_metrics()));
+}
+
+// Count a completed request
+void RequestMetrics::count_request(const bool _success) {
+  ++requests;
+  if (!_success)
+    ++failures;
+}
+
+// Forget every measure
+void RequestMetrics::reset() {
+  for (int i = 0; i < metric_count; ++i)
+    histograms[i].reset();
+  requests.store(0);
+  failures.store(0);
+  retries.store(0);
+  timeouts.store(0);
+  reconnects.store(0);
+}
+
+// {"name": ..., "requests": n, "failures": n, "retries": n, "timeouts": n,
+// "reconnects": n, "<metric>": {"count": n, "sum": n, "max": n, "p50": n,
+// "p99": n, "buckets": [[bound, n], ...]}}
+QByteArray RequestMetrics::to_json() const {
+  QByteArray json = "{\"name\": \"" + name.toUtf8() + "\", \"requests\": " + QByteArray::number(get_requests()) + ", \"failures\": " + QByteArray::number(get_failures());
+  json += ", \"retries\": " + QByteArray::number(get_retries()) + ", \"timeouts\": " + QByteArray::number(get_timeouts()) + ", \"reconnects\": " + QByteArray::number(get_reconnects());
+  for (int m = 0; m < metric_count; ++m) {
+    const LatencyHistogram& histogram = histograms[m];
+    json += ", \"" + QByteArray(metric_descriptions[m].key) + (metric_descriptions[m].duration ? "_us" : "") + "\": {";
+    json += "\"count\": " + QByteArray::number(histogram.get_count()) + ", \"sum\": " + QByteArray::number(histogram.get_sum()) + ", \"max\": " + QByteArray::number(histogram.get_max());
+    json += ", \"p50\": " + QByteArray::number(histogram.percentile(50.0)) + ", \"p99\": " + QByteArray::number(histogram.percentile(99.0)) + ", \"buckets\": [";
+    bool first = true;
+    for (int i = 0; i < LatencyHistogram::bucket_count; ++i) {
+      if (histogram.get_bucket(i) == 0)
+	continue;
+      json += (first ? "[" : ", [") + QByteArray::number(LatencyHistogram::bucket_bound(i)) + ", " + QByteArray::number(histogram.get_bucket(i)) + "]";
+      first = false;
+    }
+    json += "]}";
+  }
+  json += "}\n";
+  return json;
+}
+
+// Prometheus text format, one histogram per metric
+QByteArray RequestMetrics::to_prometheus() const {
+  const QByteArray labels = "camera=\"" + name.toUtf8() + "\"";
+  QByteArray text;
+  text += "# HELP snc_requests_total Requests completed\n# TYPE snc_requests_total counter\n";
+  text += "snc_requests_total{" + labels + "} " + QByteArray::number(get_requests()) + "\n";
+  text += "# HELP snc_request_failures_total Requests failed\n# TYPE snc_request_failures_total counter\n";
+  text += "snc_request_failures_total{" + labels + "} " + QByteArray::number(get_failures()) + "\n";
+  text += "# HELP snc_request_retries_total Requests sent again after a failure\n# TYPE snc_request_retries_total counter\n";
+  text += "snc_request_retries_total{" + labels + "} " + QByteArray::number(get_retries()) + "\n";
+  text += "# HELP snc_request_timeouts_total Requests aborted at their deadline\n# TYPE snc_request_timeouts_total counter\n";
+  text += "snc_request_timeouts_total{" + labels + "} " + QByteArray::number(get_timeouts()) + "\n";
+  text += "# HELP snc_reconnects_total Connections to the camera lost and opened again\n# TYPE snc_reconnects_total counter\n";
+  text += "snc_reconnects_total{" + labels + "} " + QByteArray::number(get_reconnects()) + "\n";
+  for (int m = 0; m < metric_count; ++m) {
+    const LatencyHistogram& histogram = histograms[m];
+    const bool duration = metric_descriptions[m].duration;
+    // The durations are recorded in us and exported in s
+    const double scale = duration ? 1e-6 : 1.0;
+    const QByteArray metric = "snc_request_" + QByteArray(metric_descriptions[m].key) + (duration ? "_seconds" : "");
+    text += "# HELP " + metric + " " + metric_descriptions[m].help + "\n# TYPE " + metric + " histogram\n";
+    quint64 cumulative = 0;
+    for (int i = 0; i < LatencyHistogram::bucket_count - 1; ++i) {
+      cumulative += histogram.get_bucket(i);
+      text += metric + "_bucket{" + labels + ",le=\"" + QByteArray::number(LatencyHistogram::bucket_bound(i) * scale, 'g', 10) + "\"} " + QByteArray::number(cumulative) + "\n";
+    }
+    text += metric + "_bucket{" + labels + ",le=\"+Inf\"} " + QByteArray::number(histogram.get_count()) + "\n";
+    text += metric + "_sum{" + labels + "} " + QByteArray::number(histogram.get_sum() * scale, 'g', 10) + "\n";
+    text += metric + "_count{" + labels + "} " + QByteArray::number(histogram.get_count()) + "\n";
+  }
+  return text;
+}
+
+// Write the metrics in a file, replaced atomically
+bool RequestMetrics::dump(const QString& _filename, const ExportFormat _format) const {
+  const QString temporary = _filename + ".tmp";
+  QFile file(temporary);
+  if (!file.open(QIODevice::WriteOnly)) {
+    std::cout << "Error while writting the metrics file" << std::endl;
+    return false;
+  }
+  const QByteArray content = (_format == prometheus_format) ? to_prometheus() : to_json();
+  const bool success = (file.write(content) == content.size());
+  file.close();
+  if (!success)
+    return false;
+  // rename() replaces the file in a single step, QFile::rename() does not
+  // replace an existing file
+  if (std::rename(QFile::encodeName(temporary).constData(), QFile::encodeName(_filename).constData()) != 0) {
+    std::cout << "Error while replacing the metrics file" << std::endl;
+    QFile::remove(temporary);
+    return false;
+  }
+  return true;
+}
+
+// Percentile of a set of values, by the nearest rank
+double RequestMetrics::percentile(std::vector<double>& _values, const double _percent) {
+  if (_values.empty())
+    return 0.0;
+  std::sort(_values.begin(), _values.end());
+  size_t rank = static_cast<size_t> (std::ceil(_percent / 100.0 * _values.size()));
+  if (rank < 1)
+    rank = 1;
+  if (rank > _values.size())
+    rank = _values.size();
+  return _values[rank - 1];
+}
+
+// Dump the metrics every _interval ms
+void RequestMetrics::start_export(const QString& _filename, const ExportFormat _format, const int _interval) {
+  export_filename = _filename;
+  export_format = _format;
+  export_timer.start((_interval < 1) ? 1 : _interval);
+}
+
+void RequestMetrics::stop_export() {
+  if (!export_timer.isActive())
+    return;
+  export_timer.stop();
+  // Keep the last measures
+  export_metrics();
+}
+
+// slot to dump the metrics periodically
+void RequestMetrics::export_metrics() {
+  dump(export_filename, export_format);
+}
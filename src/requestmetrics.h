@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef REQUESTMETRICS_H_
+#define REQUESTMETRICS_H_
+
+// stl library
+#include <atomic>
+#include <vector>
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QTimer>
+
+// Histogram with power of two buckets - bucket i counts the values in
+// ]2^(i-1), 2^i], the last one everything above. Recording is lock-free and
+// can be done from any thread.
+class LatencyHistogram
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  static const int bucket_count = 32;
+
+  LatencyHistogram();
+
+  // Record a value, thread safe
+  void record(const quint64 _value);
+  // Forget the recorded values
+  void reset();
+
+  inline quint64 get_count() const { return count.load(std::memory_order_relaxed); }
+  inline quint64 get_sum() const { return sum.load(std::memory_order_relaxed); }
+  inline quint64 get_max() const { return max.load(std::memory_order_relaxed); }
+  inline quint64 get_bucket(const int _index) const { return buckets[_index].load(std::memory_order_relaxed); }
+  // Upper bound of a bucket
+  static inline quint64 bucket_bound(const int _index) { return static_cast<quint64> (1) << _index; }
+  // Estimation of a percentile - upper bound of the bucket holding it
+  quint64 percentile(const double _percent) const;
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  std::atomic<quint64> buckets[bucket_count];
+  std::atomic<quint64> count;
+  std::atomic<quint64> sum;
+  std::atomic<quint64> max;
+
+  LatencyHistogram(const LatencyHistogram&);
+  LatencyHistogram& operator=(const LatencyHistogram&);
+};
+
+// Metrics of the requests sent to a camera. The durations are recorded in
+// microseconds, the sizes in bytes.
+class RequestMetrics : public QObject
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Measures taken on the requests:
+  //   - queue_metric: from the queueing to the sending of a request
+  //   - first_byte_metric: from the sending to the first byte of the answer
+  //   - transfer_metric: from the first byte to the end of the answer
+  //   - bytes_metric: size of the answer
+  //   - disk_write_metric: time to write an image on the disk
+  //   - settle_metric: time spent waiting for the head to stop
+  enum Metric { queue_metric, first_byte_metric, transfer_metric, bytes_metric, disk_write_metric, settle_metric, metric_count };
+  enum ExportFormat { json_format, prometheus_format };
+
+  // Constructor - _name labels the exported metrics, e.g. the camera address
+  explicit RequestMetrics(const QString& _name = QString(), QObject *parent = 0);
+
+  inline void set_name(const QString& _name) { name = _name; }
+  inline QString get_name() const { return name; }
+
+  // Record a measure, thread safe
+  inline void record(const Metric _metric, const quint64 _value) { histograms[_metric].record(_value); }
+  inline LatencyHistogram& get_histogram(const Metric _metric) { return histograms[_metric]; }
+  inline const LatencyHistogram& get_histogram(const Metric _metric) const { return histograms[_metric]; }
+  // Count a completed request
+  void count_request(const bool _success);
+  inline quint64 get_requests() const { return requests.load(); }
+  inline quint64 get_failures() const { return failures.load(); }
+  // Count the recoveries of the network layer
+  inline void count_retry() { ++retries; }
+  inline void count_timeout() { ++timeouts; }
+  inline void count_reconnect() { ++reconnects; }
+  inline quint64 get_retries() const { return retries.load(); }
+  inline quint64 get_timeouts() const { return timeouts.load(); }
+  inline quint64 get_reconnects() const { return reconnects.load(); }
+  // Forget every measure
+  void reset();
+
+  // Exact percentile of a set of values by the nearest rank, _values are
+  // sorted - the histograms only give an estimation
+  static double percentile(std::vector<double>& _values, const double _percent);
+
+  /* Export */
+  QByteArray to_json() const;
+  QByteArray to_prometheus() const;
+  // Write the metrics in a file, replaced atomically
+  bool dump(const QString& _filename, const ExportFormat _format) const;
+  // Dump the metrics every _interval ms
+  void start_export(const QString& _filename, const ExportFormat _format = json_format, const int _interval = 10000);
+  void stop_export();
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  QString name;
+  LatencyHistogram histograms[metric_count];
+  std::atomic<quint64> requests;
+  std::atomic<quint64> failures;
+  // Requests sent again, requests past their deadline and connections lost
+  std::atomic<quint64> retries;
+  std::atomic<quint64> timeouts;
+  std::atomic<quint64> reconnects;
+
+  // Private members regarding the periodic export
+  QTimer export_timer;
+  QString export_filename;
+  ExportFormat export_format;
+
+private slots:
+  // slot to dump the metrics periodically
+  void export_metrics();
+};
+
+#endif  // REQUESTMETRICS_H_
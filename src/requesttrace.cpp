@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "requesttrace.h"
+#include "sonysncrx550n.h"
+#include "requestmetrics.h"
+
+// qt library
+#include <QDateTime>
+#include <QEventLoop>
+
+// stl library
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+// Header of a trace - 16 bytes
+struct RequestTraceHeader {
+  quint32 magic;
+  quint16 version;
+  quint16 record_size;
+  qint64 start_time;
+};
+
+static_assert(sizeof(RequestTraceHeader) == 16, "The trace header has to be packed on 16 bytes");
+static_assert(sizeof(RequestTraceRecord) == 40, "The trace record has to be packed on 40 bytes");
+
+static const quint32 trace_magic = 0x54434E53;  // "SNCT"
+static const quint16 trace_version = 1;
+
+RequestTraceWriter::RequestTraceWriter(const QString& _filename) :
+  file(_filename), origin(0), next_sequence(0) {
+}
+
+// Create the trace and write its header
+bool RequestTraceWriter::open(const qint64 _time) {
+  if (file.isOpen())
+    return true;
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    std::cout << "Error while opening the trace file" << std::endl;
+    return false;
+  }
+  origin = _time;
+  next_sequence = 0;
+  pending.clear();
+  RequestTraceHeader header;
+  header.magic = trace_magic;
+  header.version = trace_version;
+  header.record_size = sizeof(RequestTraceRecord);
+  header.start_time = QDateTime::currentDateTimeUtc().toMSecsSinceEpoch();
+  if (file.write(reinterpret_cast<const char*> (&header), sizeof(header)) != static_cast<qint64> (sizeof(header))) {
+    std::cout << "Error while writting the trace file" << std::endl;
+    file.close();
+    return false;
+  }
+  return true;
+}
+
+void RequestTraceWriter::close() {
+  if (!file.isOpen())
+    return;
+  if (!pending.isEmpty())
+    std::cout << "The trace is closed with " << pending.size() << " requests running !!! They are not recorded !!!" << std::endl;
+  pending.clear();
+  file.close();
+}
+
+// A request enters the queue of the camera
+void RequestTraceWriter::queued(const quint64 _request_id, const RequestTraceRecord::Kind _kind, const QByteArray& _url, const PtzCommand& _command, const qint64 _time) {
+  if (!file.isOpen())
+    return;
+  PendingRecord& entry = pending[_request_id];
+  RequestTraceRecord& record = entry.record;
+  record.enqueue_time = _time - origin;
+  record.sequence = next_sequence++;
+  record.queue_time = 0;
+  record.latency = 0;
+  record.reply_bytes = 0;
+  record.pan_steps = static_cast<qint16> (_command.pose.pan_steps);
+  record.tilt_steps = static_cast<qint16> (_command.pose.tilt_steps);
+  record.zoom_code = _command.pose.zoom_code;
+  record.focus_code = _command.pose.focus_code;
+  record.kind = static_cast<quint8> (_kind);
+  record.flags = _command.relative ? RequestTraceRecord::relative_flag : 0;
+  record.axes = static_cast<quint8> (_command.axes);
+  record.speed = static_cast<quint8> (_command.speed);
+  // The url is cut to what a record can tell
+  record.url_length = static_cast<quint16> (std::min(_url.size(), 0xFFFF));
+  record.reserved = 0;
+  entry.url = _url.left(record.url_length);
+  entry.dispatch_time = 0;
+}
+
+// A request leaves the queue - a retry keeps the first sending
+void RequestTraceWriter::dispatched(const quint64 _request_id, const qint64 _time) {
+  auto it = pending.find(_request_id);
+  if ((it == pending.end()) || (it.value().dispatch_time != 0))
+    return;
+  it.value().dispatch_time = _time;
+}
+
+// The answer of a request is received
+void RequestTraceWriter::answered(const quint64 _request_id, const qint64 _bytes) {
+  auto it = pending.find(_request_id);
+  if (it == pending.end())
+    return;
+  it.value().record.reply_bytes = static_cast<quint32> (std::max<qint64> (_bytes, 0));
+}
+
+// A request is over, its record and its url are written in a single write
+void RequestTraceWriter::completed(const quint64 _request_id, const bool _success, const qint64 _time) {
+  auto it = pending.find(_request_id);
+  if (it == pending.end())
+    return;
+  PendingRecord entry = it.value();
+  pending.erase(it);
+  RequestTraceRecord& record = entry.record;
+  const qint64 enqueue_time = record.enqueue_time + origin;
+  // A request failed before being sent has no latency
+  const qint64 dispatch_time = (entry.dispatch_time != 0) ? entry.dispatch_time : _time;
+  record.queue_time = static_cast<quint32> (std::max<qint64> (dispatch_time - enqueue_time, 0));
+  record.latency = static_cast<quint32> (std::max<qint64> (_time - dispatch_time, 0));
+  if (_success)
+    record.flags |= RequestTraceRecord::success_flag;
+  QByteArray data(reinterpret_cast<const char*> (&record), sizeof(record));
+  data.append(entry.url);
+  if ((file.write(data) != data.size()) || (!file.flush()))
+    std::cout << "Error while writting the trace file" << std::endl;
+}
+
+RequestTraceReader::RequestTraceReader(const QString& _filename) :
+  filename(_filename), start_time(0) {
+}
+
+// Read the records written, up to the first torn one
+bool RequestTraceReader::load() {
+  records.clear();
+  urls.clear();
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly)) {
+    std::cout << "Error while opening the trace file" << std::endl;
+    return false;
+  }
+  const QByteArray content = file.readAll();
+  file.close();
+  RequestTraceHeader header;
+  if (content.size() < static_cast<int> (sizeof(header))) {
+    std::cout << "The trace file is too short !!!" << std::endl;
+    return false;
+  }
+  std::copy(content.constData(), content.constData() + sizeof(header), reinterpret_cast<char*> (&header));
+  if ((header.magic != trace_magic) || (header.version != trace_version) || (header.record_size != sizeof(RequestTraceRecord))) {
+    std::cout << "The file is not a trace of this version !!!" << std::endl;
+    return false;
+  }
+  start_time = header.start_time;
+  int offset = sizeof(header);
+  while (offset + static_cast<int> (sizeof(RequestTraceRecord)) <= content.size()) {
+    RequestTraceRecord record;
+    std::copy(content.constData() + offset, content.constData() + offset + sizeof(record), reinterpret_cast<char*> (&record));
+    if ((record.kind > RequestTraceRecord::stream_kind) || (offset + static_cast<int> (sizeof(record)) + record.url_length > content.size()))
+      break;
+    offset += sizeof(record);
+    records.push_back(record);
+    urls.push_back(content.mid(offset, record.url_length));
+    offset += record.url_length;
+  }
+  if (offset != content.size())
+    std::cout << "The trace was not closed properly !!! " << (content.size() - offset) << " bytes dropped !!!" << std::endl;
+  // The records are written as the requests complete, replay them as queued
+  std::vector<int> order(records.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = static_cast<int> (i);
+  std::sort(order.begin(), order.end(), [this](const int _a, const int _b) { return records[_a].sequence < records[_b].sequence; });
+  std::vector<RequestTraceRecord> sorted_records;
+  std::vector<QByteArray> sorted_urls;
+  sorted_records.reserve(order.size());
+  sorted_urls.reserve(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    sorted_records.push_back(records[order[i]]);
+    sorted_urls.push_back(urls[order[i]]);
+  }
+  records.swap(sorted_records);
+  urls.swap(sorted_urls);
+  return true;
+}
+
+// Percentile of latencies in us, in ms
+static double latency_percentile(std::vector<double>& _latencies, const double _percent) {
+  return RequestMetrics::percentile(_latencies, _percent) / 1000.0;
+}
+
+// Latency and throughput of the trace
+TraceSummary RequestTraceReader::summarize() const {
+  TraceSummary summary = {0, 0, 0, 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  if (records.empty())
+    return summary;
+  std::vector<double> command_latencies;
+  std::vector<double> image_latencies;
+  std::vector<double> settle_latencies;
+  qint64 first_time = records.front().enqueue_time;
+  qint64 last_time = first_time;
+  double total_queue_time = 0.0;
+  quint64 total_bytes = 0;
+  for (size_t i = 0; i < records.size(); ++i) {
+    const RequestTraceRecord& record = records[i];
+    const bool success = (record.flags & RequestTraceRecord::success_flag) != 0;
+    ++summary.requests;
+    if (!success)
+      ++summary.failures;
+    total_queue_time += record.queue_time;
+    first_time = std::min(first_time, record.enqueue_time);
+    last_time = std::max(last_time, record.enqueue_time + record.queue_time + record.latency);
+    if (record.kind == RequestTraceRecord::command_kind) {
+      ++summary.commands;
+      command_latencies.push_back(record.latency);
+    }
+    else if (record.kind == RequestTraceRecord::settle_kind)
+      settle_latencies.push_back(record.latency);
+    else {
+      image_latencies.push_back(record.latency);
+      if (success) {
+	++summary.images;
+	total_bytes += record.reply_bytes;
+      }
+    }
+  }
+  // Same percentiles as the benchmark
+  summary.command_p50 = latency_percentile(command_latencies, 50.0);
+  summary.command_p99 = latency_percentile(command_latencies, 99.0);
+  summary.image_p50 = latency_percentile(image_latencies, 50.0);
+  summary.image_p99 = latency_percentile(image_latencies, 99.0);
+  summary.settle_p50 = latency_percentile(settle_latencies, 50.0);
+  summary.settle_p99 = latency_percentile(settle_latencies, 99.0);
+  summary.mean_queue_time = total_queue_time / summary.requests / 1000.0;
+  summary.duration = (last_time - first_time) / 1000000.0;
+  if (summary.duration > 0.0) {
+    summary.requests_per_second = summary.requests / summary.duration;
+    summary.images_per_second = summary.images / summary.duration;
+    summary.megabytes_per_second = total_bytes / (1024.0 * 1024.0) / summary.duration;
+  }
+  return summary;
+}
+
+RequestTraceReplayer::RequestTraceReplayer(SonySNCRX550N* _camera, QObject *parent) :
+  QObject(parent), camera(_camera), reader(0), speed(original_speed), next_record(0), replaying(false) {
+  issue_timer.setSingleShot(true);
+  connect(&issue_timer, SIGNAL(timeout()), this, SLOT(issue_due()));
+}
+
+// Replay a trace and record the replay, block the caller until the end
+bool RequestTraceReplayer::replay(const QString& _trace, const QString& _replay_trace, const QString& _directory_storage, const ReplaySpeed _speed) {
+  if (replaying)
+    return false;
+  RequestTraceReader trace_reader(_trace);
+  if (!trace_reader.load())
+    return false;
+  if (trace_reader.size() == 0) {
+    std::cout << "The trace holds no request !!! Nothing to replay !!!" << std::endl;
+    return false;
+  }
+  if (!camera->start_trace(_replay_trace))
+    return false;
+  camera->set_directory_storage(_directory_storage);
+  // The barriers of the trace are replayed as recorded, none is added
+  const bool settle = camera->get_settle_before_capture();
+  camera->set_settle_before_capture(false);
+  reader = &trace_reader;
+  speed = _speed;
+  next_record = 0;
+  replaying = true;
+  connect(camera, SIGNAL(idle()), this, SLOT(camera_idle()));
+  QEventLoop loop;
+  connect(this, SIGNAL(replay_finished()), &loop, SLOT(quit()));
+  clock.start();
+  issue_due();
+  if (replaying)
+    loop.exec();
+  disconnect(camera, SIGNAL(idle()), this, SLOT(camera_idle()));
+  issue_timer.stop();
+  reader = 0;
+  camera->set_settle_before_capture(settle);
+  camera->stop_trace();
+  return true;
+}
+
+// Queue one request of the trace, the camera builds its url again
+void RequestTraceReplayer::issue(const RequestTraceRecord& _record) {
+  switch (_record.kind) {
+  case RequestTraceRecord::command_kind: {
+    PtzCommand command;
+    command.axes = _record.axes;
+    command.relative = (_record.flags & RequestTraceRecord::relative_flag) != 0;
+    command.pose.pan_steps = _record.pan_steps;
+    command.pose.tilt_steps = _record.tilt_steps;
+    command.pose.zoom_code = _record.zoom_code;
+    command.pose.focus_code = _record.focus_code;
+    command.speed = _record.speed;
+    camera->command(command);
+    break;
+  }
+  case RequestTraceRecord::settle_kind:
+    camera->wait_for_settle();
+    break;
+  default:
+    camera->grab_image();
+    break;
+  }
+}
+
+// slot to queue the requests which are due
+void RequestTraceReplayer::issue_due() {
+  if (!replaying)
+    return;
+  const qint64 first_time = reader->record(0).enqueue_time;
+  while (next_record < reader->size()) {
+    const RequestTraceRecord& record = reader->record(next_record);
+    if (speed == original_speed) {
+      const qint64 wait = (record.enqueue_time - first_time) - clock.nsecsElapsed() / 1000;
+      if (wait > 0) {
+	issue_timer.start(static_cast<int> ((wait + 999) / 1000));
+	return;
+      }
+    }
+    issue(record);
+    ++next_record;
+  }
+  // Every request may already be over
+  if (camera->get_pending_requests() == 0)
+    camera_idle();
+}
+
+// slot to end the replay once every request is issued and done
+void RequestTraceReplayer::camera_idle() {
+  if ((!replaying) || (next_record < reader->size()))
+    return;
+  replaying = false;
+  emit replay_finished();
+}
+
+// Row of the comparison
+static void print_row(const char* _name, const double _recorded, const double _replayed) {
+  std::cout << std::left << std::setw(24) << _name << std::right << std::setw(12) << _recorded << std::setw(12) << _replayed;
+  if (_recorded != 0.0)
+    std::cout << std::setw(10) << (_replayed / _recorded) << "x";
+  std::cout << std::endl;
+}
+
+// Print the summaries of a trace and of its replay side by side
+void RequestTraceReplayer::print_comparison(const TraceSummary& _recorded, const TraceSummary& _replayed) {
+  const std::ios_base::fmtflags flags = std::cout.flags();
+  const std::streamsize precision = std::cout.precision();
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << std::left << std::setw(24) << "" << std::right << std::setw(12) << "recorded" << std::setw(12) << "replayed" << std::setw(11) << "ratio" << std::endl;
+  print_row("requests", _recorded.requests, _replayed.requests);
+  print_row("failures", _recorded.failures, _replayed.failures);
+  print_row("commands", _recorded.commands, _replayed.commands);
+  print_row("images", _recorded.images, _replayed.images);
+  print_row("command p50 (ms)", _recorded.command_p50, _replayed.command_p50);
+  print_row("command p99 (ms)", _recorded.command_p99, _replayed.command_p99);
+  print_row("image p50 (ms)", _recorded.image_p50, _replayed.image_p50);
+  print_row("image p99 (ms)", _recorded.image_p99, _replayed.image_p99);
+  print_row("settle p50 (ms)", _recorded.settle_p50, _replayed.settle_p50);
+  print_row("settle p99 (ms)", _recorded.settle_p99, _replayed.settle_p99);
+  print_row("mean queue time (ms)", _recorded.mean_queue_time, _replayed.mean_queue_time);
+  print_row("duration (s)", _recorded.duration, _replayed.duration);
+  print_row("requests/s", _recorded.requests_per_second, _replayed.requests_per_second);
+  print_row("images/s", _recorded.images_per_second, _replayed.images_per_second);
+  print_row("MB/s", _recorded.megabytes_per_second, _replayed.megabytes_per_second);
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef REQUESTTRACE_H_
+#define REQUESTTRACE_H_
+
+// stl library
+#include <vector>
+
+// qt library
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "ptzcodec.h"
+
+class SonySNCRX550N;
+
+// A trace is a file of the requests queued by the driver, written as each
+// one completes:
+//
+//   [header][record][url][record][url]...
+//
+// The header holds the magic, the version, the size of a record and the
+// start of the trace in ms since epoch. A record torn by the death of the
+// process is dropped when the trace is read. The values are stored in the
+// byte order of the host.
+
+// Record of a request - 40 bytes followed by the path and the query of its
+// url. The times are in us.
+struct RequestTraceRecord {
+  enum Kind { command_kind, image_kind, settle_kind, stream_kind };
+  enum Flag { success_flag = 1, relative_flag = 2 };
+
+  // Queueing since the start of the trace, and order of the queueing
+  qint64 enqueue_time;
+  quint32 sequence;
+  // From the queueing to the sending, and from the sending to the end -
+  // retries included
+  quint32 queue_time;
+  quint32 latency;
+  quint32 reply_bytes;
+  // Command of a command request, see PtzCommand
+  qint16 pan_steps;
+  qint16 tilt_steps;
+  quint16 zoom_code;
+  quint16 focus_code;
+  quint8 kind;
+  quint8 flags;
+  quint8 axes;
+  quint8 speed;
+  quint16 url_length;
+  quint16 reserved;
+};
+
+// Record the requests of a camera - see SonySNCRX550N::start_trace()
+class RequestTraceWriter
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  explicit RequestTraceWriter(const QString& _filename);
+
+  // Create the trace, _time is the clock of the requests when it starts
+  bool open(const qint64 _time);
+  inline bool is_open() const { return file.isOpen(); }
+  // The requests not completed yet are left out
+  void close();
+  inline QString get_filename() const { return file.fileName(); }
+
+  // Steps of a request, the times on the clock given to open()
+  void queued(const quint64 _request_id, const RequestTraceRecord::Kind _kind, const QByteArray& _url, const PtzCommand& _command, const qint64 _time);
+  void dispatched(const quint64 _request_id, const qint64 _time);
+  void answered(const quint64 _request_id, const qint64 _bytes);
+  void completed(const quint64 _request_id, const bool _success, const qint64 _time);
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  QFile file;
+  qint64 origin;
+  quint32 next_sequence;
+  // Request queued and not completed yet
+  struct PendingRecord {
+    RequestTraceRecord record;
+    QByteArray url;
+    qint64 dispatch_time;
+  };
+  QHash<quint64, PendingRecord> pending;
+
+  RequestTraceWriter(const RequestTraceWriter&);
+  RequestTraceWriter& operator=(const RequestTraceWriter&);
+};
+
+// Latency and throughput of a trace, the times are in ms
+struct TraceSummary {
+  int requests;
+  int failures;
+  int commands;
+  int images;
+  double command_p50;
+  double command_p99;
+  double image_p50;
+  double image_p99;
+  double settle_p50;
+  double settle_p99;
+  double mean_queue_time;
+  // From the first queueing to the last completion, in s
+  double duration;
+  double requests_per_second;
+  double images_per_second;
+  double megabytes_per_second;
+};
+
+class RequestTraceReader
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  explicit RequestTraceReader(const QString& _filename);
+
+  // Read the records written, up to the first torn one. The records are
+  // given in the order of their queueing.
+  bool load();
+  inline int size() const { return static_cast<int> (records.size()); }
+  inline const RequestTraceRecord& record(const int _index) const { return records[_index]; }
+  inline const QByteArray& url(const int _index) const { return urls[_index]; }
+  // Start of the trace in ms since epoch, UTC
+  inline qint64 get_start_time() const { return start_time; }
+
+  TraceSummary summarize() const;
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  QString filename;
+  qint64 start_time;
+  std::vector<RequestTraceRecord> records;
+  std::vector<QByteArray> urls;
+};
+
+// Queue the requests of a trace again on a camera, at the pace they were
+// recorded or as fast as the camera takes them. The replay is itself traced
+// so that both can be compared.
+class RequestTraceReplayer : public QObject
+{
+  Q_OBJECT
+
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  enum ReplaySpeed { original_speed, maximum_speed };
+
+  // Constructor - the camera is not owned
+  explicit RequestTraceReplayer(SonySNCRX550N* _camera, QObject *parent = 0);
+
+  // Replay _trace and record the replay in _replay_trace, block the caller
+  // until the camera is idle. The images are stored in _directory_storage.
+  bool replay(const QString& _trace, const QString& _replay_trace, const QString& _directory_storage, const ReplaySpeed _speed = original_speed);
+
+  // Print the summaries of a trace and of its replay side by side
+  static void print_comparison(const TraceSummary& _recorded, const TraceSummary& _replayed);
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  SonySNCRX550N* camera;
+
+  // Private members regarding the running replay
+  const RequestTraceReader* reader;
+  ReplaySpeed speed;
+  int next_record;
+  QElapsedTimer clock;
+  QTimer issue_timer;
+  bool replaying;
+
+  // Queue one request of the trace
+  void issue(const RequestTraceRecord& _record);
+
+private slots:
+  // slot to queue the requests which are due
+  void issue_due();
+  // slot to end the replay once every request is issued and done
+  void camera_idle();
+
+signals:
+  // Emitted when the replay is over
+  void replay_finished();
+};
+
+#endif  // REQUESTTRACE_H_
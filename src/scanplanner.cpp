@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "scanplanner.h"
+#include "ptzcodec.h"
+
+// stl library
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Sort the poses by row and then by column
+static bool pose_row_order(const ScanPose& _a, const ScanPose& _b) {
+  if (_a.tilt != _b.tilt)
+    return _a.tilt < _b.tilt;
+  return _a.pan < _b.pan;
+}
+
+// The default velocities correspond to about 300 degrees per second on both
+// axes at the highest speed. They can be refined from the measured times.
+ScanPlanner::ScanPlanner(const PathMode _mode) :
+  mode(_mode),
+  pan_velocity(300.0 * PtzCodec::pan_steps / PtzCodec::pan_angle),
+  tilt_velocity(300.0 * PtzCodec::tilt_steps / PtzCodec::tilt_angle),
+  move_overhead(0.1) {
+}
+
+// Build the pose grid of a spherical acquisition. The column at +180 degrees
+// is the same direction as the one at -180 degrees and is not repeated.
+std::vector<ScanPose> ScanPlanner::spherical_grid(const long step_pan, const long step_tilt, const QString& _zoom, const QString& _focus) {
+  std::vector<ScanPose> poses;
+  if ((step_pan < 1) || (step_tilt < 1))
+    return poses;
+  // Compute the increment for the pan and tilt
+  double angle_pan_inc = PtzCodec::pan_angle / step_pan;
+  double angle_tilt_inc = PtzCodec::tilt_angle / step_tilt;
+  poses.reserve((step_tilt + 1) * step_pan);
+  for (long row = 0; row <= step_tilt; ++row) {
+    for (long col = 0; col < step_pan; ++col) {
+      ScanPose pose;
+      pose.pan = min_panning_abs + col * angle_pan_inc;
+      pose.tilt = std::min(min_tilt_abs + row * angle_tilt_inc, static_cast<double> (max_tilt_abs));
+      pose.zoom = _zoom;
+      pose.focus = _focus;
+      poses.push_back(pose);
+    }
+  }
+  return poses;
+}
+
+// Magnification of a zoom position: oz-N is N times, dz-K is 25 K times
+double ScanPlanner::magnification(const QString& _zoom) {
+  bool ok = false;
+  const double level = _zoom.mid(3).toDouble(&ok);
+  if ((!ok) || (level < 1.0))
+    return 1.0;
+  if (_zoom.startsWith("dz-"))
+    return optical_zoom_ratio * level;
+  return std::min(level, static_cast<double> (optical_zoom_ratio));
+}
+
+// Horizontal field of view in degrees of a zoom position
+double ScanPlanner::horizontal_fov(const QString& _zoom) {
+  const double half_wide = wide_horizontal_fov * M_PI / 360.0;
+  return 360.0 / M_PI * std::atan(std::tan(half_wide) / magnification(_zoom));
+}
+
+// Vertical field of view in degrees of a zoom position
+double ScanPlanner::vertical_fov(const QString& _zoom) {
+  const double half_horizontal = horizontal_fov(_zoom) * M_PI / 360.0;
+  return 360.0 / M_PI * std::atan(std::tan(half_horizontal) / frame_aspect_ratio);
+}
+
+// Build the smallest grid covering the range of viewing directions. The rows
+// are spread over the tilt range, then each row gets as few columns as
+// possible: away from the horizon a frame spans a wider pan angle, so the
+// rows close to the limits need less frames.
+std::vector<ScanPose> ScanPlanner::coverage_grid(const double _pan_min, const double _pan_max, const double _tilt_min, const double _tilt_max, const QString& _zoom, const QString& _focus, const double _overlap) {
+  std::vector<ScanPose> poses;
+  if ((_overlap < 0.0) || (_overlap > 90.0) || (_pan_max <= _pan_min) || (_tilt_max < _tilt_min))
+    return poses;
+  const double keep = 1.0 - _overlap / 100.0;
+  const double hfov = horizontal_fov(_zoom);
+  const double vfov = vertical_fov(_zoom);
+  // Rows - the centres stay within the mechanical range of the head
+  const double tilt_range = _tilt_max - _tilt_min;
+  const long rows = (tilt_range <= vfov) ? 1 : static_cast<long> (std::ceil((tilt_range - vfov) / (vfov * keep))) + 1;
+  const double first_tilt = (rows == 1) ? 0.5 * (_tilt_min + _tilt_max) : _tilt_min + 0.5 * vfov;
+  const double tilt_inc = (rows == 1) ? 0.0 : (tilt_range - vfov) / (rows - 1);
+  const bool full_turn = (_pan_max - _pan_min) >= PtzCodec::pan_angle;
+  for (long row = 0; row < rows; ++row) {
+    double tilt = first_tilt + row * tilt_inc;
+    tilt = std::max(static_cast<double> (min_tilt_abs), std::min(tilt, static_cast<double> (max_tilt_abs)));
+    // Pan angle spanned by the frame on its edge closest to the horizon
+    const double horizon_edge = std::max(0.0, std::fabs(tilt) - 0.5 * vfov);
+    const double pan_span = std::min(static_cast<double> (PtzCodec::pan_angle), hfov / std::cos(horizon_edge * M_PI / 180.0));
+    long cols;
+    double first_pan;
+    double pan_inc;
+    if (full_turn) {
+      cols = static_cast<long> (std::ceil(PtzCodec::pan_angle / (pan_span * keep)));
+      first_pan = min_panning_abs;
+      pan_inc = PtzCodec::pan_angle / cols;
+    }
+    else {
+      const double pan_range = _pan_max - _pan_min;
+      cols = (pan_range <= pan_span) ? 1 : static_cast<long> (std::ceil((pan_range - pan_span) / (pan_span * keep))) + 1;
+      first_pan = (cols == 1) ? 0.5 * (_pan_min + _pan_max) : _pan_min + 0.5 * pan_span;
+      pan_inc = (cols == 1) ? 0.0 : (pan_range - pan_span) / (cols - 1);
+    }
+    for (long col = 0; col < cols; ++col) {
+      ScanPose pose;
+      // Bring the pan angle back into -180 to 180
+      pose.pan = std::remainder(first_pan + col * pan_inc, PtzCodec::pan_angle);
+      if (pose.pan >= max_panning_abs)
+	pose.pan -= PtzCodec::pan_angle;
+      pose.tilt = tilt;
+      pose.zoom = _zoom;
+      pose.focus = _focus;
+      poses.push_back(pose);
+    }
+  }
+  return poses;
+}
+
+// Full sphere reachable by the head at the given zoom
+std::vector<ScanPose> ScanPlanner::spherical_coverage_grid(const QString& _zoom, const QString& _focus, const double _overlap) {
+  const double half_vfov = 0.5 * vertical_fov(_zoom);
+  return coverage_grid(min_panning_abs, max_panning_abs, min_tilt_abs - half_vfov, max_tilt_abs + half_vfov, _zoom, _focus, _overlap);
+}
+
+// Higher zoom tiles covering the frame taken at a pose of a coarser level
+std::vector<ScanPose> ScanPlanner::refinement_grid(const ScanPose& _parent, const QString& _zoom, const double _overlap) {
+  const double half_vfov = 0.5 * vertical_fov(_parent.zoom);
+  const double horizon_edge = std::max(0.0, std::fabs(_parent.tilt) - half_vfov);
+  const double half_span = 0.5 * std::min(static_cast<double> (PtzCodec::pan_angle), horizontal_fov(_parent.zoom) / std::cos(horizon_edge * M_PI / 180.0));
+  return coverage_grid(_parent.pan - half_span, _parent.pan + half_span, _parent.tilt - half_vfov, _parent.tilt + half_vfov, _zoom, _parent.focus, _overlap);
+}
+
+// Order the poses starting from the given one
+std::vector<ScanPose> ScanPlanner::plan(const std::vector<ScanPose>& _poses, const ScanPose& _start) const {
+  switch (mode) {
+  case raster_path:
+    return plan_raster(_poses);
+  case nearest_neighbour_path:
+    return plan_nearest_neighbour(_poses, _start);
+  case serpentine_path:
+  default:
+    return plan_serpentine(_poses);
+  }
+}
+
+// Predicted time in seconds to move between two poses at a given speed
+double ScanPlanner::move_time(const ScanPose& _from, const ScanPose& _to, const long _speed) const {
+  if ((_from.pan == _to.pan) && (_from.tilt == _to.tilt))
+    return 0.0;
+  long bounded_speed = _speed;
+  if (bounded_speed < PtzCodec::min_speed)
+    bounded_speed = PtzCodec::min_speed;
+  else if (bounded_speed > PtzCodec::max_speed)
+    bounded_speed = PtzCodec::max_speed;
+  const double speed_ratio = static_cast<double> (bounded_speed) / static_cast<double> (PtzCodec::max_speed);
+  // Convert the travel to motor steps
+  // The absolute pan range is -170 to 170 degrees, the head goes through 0
+  // and never takes the way around by 180
+  const double pan_steps = std::fabs(_to.pan - _from.pan) * PtzCodec::pan_steps / PtzCodec::pan_angle;
+  const double tilt_steps = std::fabs(_to.tilt - _from.tilt) * PtzCodec::tilt_steps / PtzCodec::tilt_angle;
+  const double pan_time = pan_steps / (pan_velocity * speed_ratio);
+  const double tilt_time = tilt_steps / (tilt_velocity * speed_ratio);
+  return move_overhead + std::max(pan_time, tilt_time);
+}
+
+// Predicted time in seconds to visit all the poses in order
+double ScanPlanner::traversal_time(const std::vector<ScanPose>& _poses, const ScanPose& _start, const long _speed) const {
+  double total_time = 0.0;
+  const ScanPose* previous = &_start;
+  for (auto it = _poses.begin(); it != _poses.end(); ++it) {
+    total_time += move_time(*previous, *it, _speed);
+    previous = &(*it);
+  }
+  return total_time;
+}
+
+// Each row starts again from the smallest pan angle
+std::vector<ScanPose> ScanPlanner::plan_raster(const std::vector<ScanPose>& _poses) const {
+  std::vector<ScanPose> path(_poses);
+  std::stable_sort(path.begin(), path.end(), pose_row_order);
+  return path;
+}
+
+// Every other row is visited backward so that the head never slews back
+std::vector<ScanPose> ScanPlanner::plan_serpentine(const std::vector<ScanPose>& _poses) const {
+  std::vector<ScanPose> path = plan_raster(_poses);
+  bool backward = false;
+  auto row_begin = path.begin();
+  while (row_begin != path.end()) {
+    auto row_end = row_begin;
+    while ((row_end != path.end()) && (row_end->tilt == row_begin->tilt))
+      ++row_end;
+    if (backward)
+      std::reverse(row_begin, row_end);
+    backward = !backward;
+    row_begin = row_end;
+  }
+  return path;
+}
+
+// Greedy ordering - the cheapest pose to reach from the current one is next
+std::vector<ScanPose> ScanPlanner::plan_nearest_neighbour(const std::vector<ScanPose>& _poses, const ScanPose& _start) const {
+  std::vector<ScanPose> remaining = plan_raster(_poses);
+  std::vector<ScanPose> path;
+  path.reserve(remaining.size());
+  ScanPose current = _start;
+  while (!remaining.empty()) {
+    size_t best = 0;
+    double best_time = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < remaining.size(); ++i) {
+      double time = move_time(current, remaining[i], planning_speed);
+      if (time < best_time) {
+	best_time = time;
+	best = i;
+      }
+    }
+    current = remaining[best];
+    path.push_back(current);
+    remaining.erase(remaining.begin() + best);
+  }
+  return path;
+}
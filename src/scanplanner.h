@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef SCANPLANNER_H_
+#define SCANPLANNER_H_
+
+// stl library
+#include <vector>
+
+// qt library
+#include <QString>
+
+// Pose of the camera to visit during a scan
+struct ScanPose {
+  double pan;
+  double tilt;
+  QString zoom;
+  QString focus;
+};
+
+class ScanPlanner
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Order in which the poses of a grid are visited:
+  //   - raster_path: each row starts again from the smallest pan angle
+  //   - serpentine_path: every other row is visited backward
+  //   - nearest_neighbour_path: the cheapest pose to reach is visited next
+  enum PathMode { raster_path, serpentine_path, nearest_neighbour_path };
+
+  // Constructor
+  explicit ScanPlanner(const PathMode _mode = serpentine_path);
+
+  /* Path management */
+  inline void set_path_mode(const PathMode _mode) { mode = _mode; }
+  inline PathMode get_path_mode() const { return mode; }
+
+  // Build the pose grid of a spherical acquisition
+  // step_pan: number of columns over 360 degrees
+  // step_tilt: number of rows over 96 degrees
+  static std::vector<ScanPose> spherical_grid(const long step_pan, const long step_tilt, const QString& _zoom = "oz-1", const QString& _focus = "f-inf");
+
+  /* Zoom aware grid */
+  // Magnification of a zoom position: oz-N is N times, dz-K is 25 K times -
+  // the digital zoom starts from the last optical position, oz-25
+  static double magnification(const QString& _zoom);
+  // Horizontal and vertical field of view in degrees of a zoom position
+  static double horizontal_fov(const QString& _zoom);
+  static double vertical_fov(const QString& _zoom);
+
+  // Build the smallest grid covering the given range of viewing directions
+  // with the requested overlap between neighbouring frames:
+  // _pan_min, _pan_max: pan range in degrees, 360 degrees wraps around
+  // _tilt_min, _tilt_max: tilt range in degrees
+  // _overlap: overlap between frames in percent | 0 to 90
+  static std::vector<ScanPose> coverage_grid(const double _pan_min, const double _pan_max, const double _tilt_min, const double _tilt_max, const QString& _zoom, const QString& _focus, const double _overlap);
+  // Full sphere reachable by the head at the given zoom
+  static std::vector<ScanPose> spherical_coverage_grid(const QString& _zoom, const QString& _focus, const double _overlap);
+  // Higher zoom tiles covering the frame taken at a pose of a coarser level
+  static std::vector<ScanPose> refinement_grid(const ScanPose& _parent, const QString& _zoom, const double _overlap);
+
+  // Order the poses starting from the given one
+  std::vector<ScanPose> plan(const std::vector<ScanPose>& _poses, const ScanPose& _start) const;
+
+  /* Cost model */
+  // The velocity of each axis at the highest speed, in motor steps per second.
+  // The velocity is considered linear with the speed command (1 to 24).
+  inline void set_pan_velocity(const double _steps_per_second) { pan_velocity = _steps_per_second; }
+  inline void set_tilt_velocity(const double _steps_per_second) { tilt_velocity = _steps_per_second; }
+  // Constant time paid by every move - acceleration and command round-trip
+  inline void set_move_overhead(const double _seconds) { move_overhead = _seconds; }
+
+  // Predicted time in seconds to move between two poses at a given speed.
+  // Pan and tilt are driven at the same time, the slowest axis wins.
+  double move_time(const ScanPose& _from, const ScanPose& _to, const long _speed) const;
+  // Predicted time in seconds to visit all the poses in order
+  double traversal_time(const std::vector<ScanPose>& _poses, const ScanPose& _start, const long _speed) const;
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  PathMode mode;
+
+  // Private members of the cost model
+  double pan_velocity;
+  double tilt_velocity;
+  double move_overhead;
+  // Speed used to order the poses when the actual one is unknown
+  static const long planning_speed = 24;
+
+  // Private parameter regarding the range of the head, the steps and the
+  // speeds of the axes are the ones of PtzCodec
+  static constexpr double min_panning_abs = -180.0;
+  static constexpr double min_tilt_abs = -48.0;
+  static constexpr double max_tilt_abs = 48.0;
+  static constexpr double max_panning_abs = 180.0;
+
+  // Private parameter regarding the lens - optical positions up to oz-25
+  // with an horizontal view angle of 55.4 degrees at the wide end and 4:3
+  // frames
+  static constexpr double wide_horizontal_fov = 55.4;
+  static constexpr double frame_aspect_ratio = 4.0 / 3.0;
+  static constexpr double optical_zoom_ratio = 25.0;
+
+  // Ordering strategies
+  std::vector<ScanPose> plan_raster(const std::vector<ScanPose>& _poses) const;
+  std::vector<ScanPose> plan_serpentine(const std::vector<ScanPose>& _poses) const;
+  std::vector<ScanPose> plan_nearest_neighbour(const std::vector<ScanPose>& _poses, const ScanPose& _start) const;
+};
+
+#endif  // SCANPLANNER_H_
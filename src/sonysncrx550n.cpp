@@ -25,21 +25,66 @@
 #include <QCoreApplication>
 #include <QDateTime>
 #include <QFile>
+#include <QFileInfo>
 #include <QStringList>
+#include <QTimer>
+#include <QLatin1String>
 
 // stl library
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <unistd.h>
 
-// Initialise the value that the zoom position can take
-const std::map< QString, QString > SonySNCRX550N::zoom_position_key_to_hex = { {"oz-1", "0000"}, {"oz-2", "1760"}, {"oz-3", "214C"}, {"oz-4", "2722"}, {"oz-5", "2B22"}, {"oz-6", "2E20"}, {"oz-7", "3080"}, {"oz-8", "3278"}, {"oz-9", "3426"}, {"oz-10", "359E"}, {"oz-11", "36EE"}, {"oz-12", "381C"}, {"oz-13", "392E"}, {"oz-14", "3A26"}, {"oz-15", "3B08"}, {"oz-16", "3BD4"}, {"oz-17", "3C8C"}, {"oz-18", "3D2E"}, {"oz-19", "3DBC"}, {"oz-20", "3E58"}, {"oz-21", "3EA2"}, {"oz-22", "3F00"}, {"oz-23", "3F4E"}, {"oz-24", "3F92"}, {"oz-25", "3FCC"}, {"dz-1", "4000"}, {"dz-2", "6000"}, {"dz-3", "6A80"}, {"dz-4", "7000"}, {"dz-5", "7300"}, {"dz-6", "7540"}, {"dz-7", "76C0"}, {"dz-8", "7800"}, {"dz-9", "78C0"}, {"dz-10", "7980"}, {"dz-11", "7A00"}, {"dz-12", "7AC0"} };
-const std::map< QString, QString > SonySNCRX550N::zoom_position_hex_to_key = { {"0000", "oz-1"}, {"1760", "oz-2"}, {"214C", "oz-3"}, {"2722", "oz-4"}, {"2B22", "oz-5"}, {"2E20", "oz-6"}, {"3080", "oz-7"}, {"3278", "oz-8"}, {"3426", "oz-9"}, {"359E", "oz-10"}, {"36EE", "oz-11"}, {"381C", "oz-12"}, {"392E", "oz-13"}, {"3A26", "oz-14"}, {"3B08", "oz-15"}, {"3BD4", "oz-16"}, {"3C8C", "oz-17"}, {"3D2E", "oz-18"}, {"3DBC", "oz-19"}, {"3E58", "oz-20"}, {"3EA2", "oz-21"}, {"3F00", "oz-22"}, {"3F4E", "oz-23"}, {"3F92", "oz-24"}, {"3FCC", "oz-25"}, {"4000", "dz-1"}, {"6000", "dz-2"}, {"6A80", "dz-3"}, {"7000", "dz-4"}, {"7300", "dz-5"}, {"7540", "dz-6"}, {"76C0", "dz-7"}, {"7800", "dz-8"}, {"78C0", "dz-9"}, {"7980", "dz-10"}, {"7A00", "dz-11"}, {"7AC0", "dz-12"} };
+// Journal of the acquisitions, in the sphere directory or along the archive
+const char* const SonySNCRX550N::journal_filename = "acquisition.journal";
+const char* const SonySNCRX550N::journal_suffix = ".journal";
 
-const std::map< QString, QString > SonySNCRX550N::focus_position_key_to_hex = { {"f-inf", "1000"}, {"f-7200", "2000"}, {"f-3300", "3000"}, {"f-2000", "4000"}, {"f-1300", "5000"}, {"f-1000", "6000"}, {"f-800", "7000"}, {"f-400", "8000"}, {"f-200", "9000"}, {"f-110", "A000"}, {"f-60", "B000"}, {"f-35", "C000"} };
-const std::map< QString, QString > SonySNCRX550N::focus_position_hex_to_key = { {"1000", "f-inf"}, {"2000", "f-7200"}, {"3000", "f-3300"}, {"4000", "f-2000"}, {"5000", "f-1300"}, {"6000", "f-1000"}, {"7000", "f-800"}, {"8000", "f-400"}, {"9000", "f-200"}, {"A000", "f-110"}, {"B000", "f-60"}, {"C000", "f-35"} };
+// Conversion between the zoom and focus positions and their codes
+quint16 SonySNCRX550N::zoom_code(const QString& _zoom_position) {
+  return PtzCodec::zoom_code(_zoom_position);
+}
+
+quint16 SonySNCRX550N::focus_code(const QString& _focus_position) {
+  return PtzCodec::focus_code(_focus_position);
+}
+
+QString SonySNCRX550N::zoom_key(const quint16 _zoom_code) {
+  const char* key = PtzCodec::zoom_key(_zoom_code);
+  return (key != 0) ? QString(QLatin1String(key)) : QString::number(_zoom_code, 16).toUpper().rightJustified(4, '0');
+}
+
+QString SonySNCRX550N::focus_key(const quint16 _focus_code) {
+  const char* key = PtzCodec::focus_key(_focus_code);
+  return (key != 0) ? QString(QLatin1String(key)) : QString::number(_focus_code, 16).toUpper().rightJustified(4, '0');
+}
 
-SonySNCRX550N::SonySNCRX550N(const QString& _ip_address, QObject *parent) : 
-  QObject(parent) {
+SonySNCRX550N::SonySNCRX550N(const QString& _ip_address, QObject *parent, QNetworkAccessManager* _net_acc_manager, const StartupMode _startup) : 
+  QObject(parent), net_acc_manager(_net_acc_manager), max_in_flight(default_max_in_flight), next_request_id(0),
+  request_timeout(default_request_timeout), max_retries(default_max_retries), retry_backoff(default_retry_backoff),
+  deadline_timer(this), retry_timer(this),
+  metrics(_ip_address), verbose(true),
+  settle_before_capture(true), motion_pending(false),
+  settle_poll_interval(default_settle_poll_interval), settle_timeout(default_settle_timeout),
+  stable_readings(0), settle_in_progress(false), known_axes((_startup == home_startup) ? all_axes : 0), position_read_queued(false),
+  real_pan_pos(0), real_tilt_pos(0), real_zoom_code(PtzCodec::invalid_code), real_focus_code(PtzCodec::invalid_code),
+  acquisition_last_request(0), acquisition_predicted_traversal(0), acquisition_measured_traversal(0),
+  archive_output(false), change_detection(false), mjpeg_stream(0), capture_from_stream(true) {
+  request_clock.start();
+  // Set up the timers of the failed requests
+  connect(&deadline_timer, SIGNAL(timeout()), this, SLOT(check_deadlines()));
+  retry_timer.setSingleShot(true);
+  connect(&retry_timer, SIGNAL(timeout()), this, SLOT(resume_dispatch()));
+  // Set up the writer of the images
+  frame_writer = new FrameWriter(2, this);
+  frame_writer->set_latency_histogram(&metrics.get_histogram(RequestMetrics::disk_write_metric));
+  frame_writer->set_change_detector(&change_detector);
+  connect(frame_writer, SIGNAL(frame_written(quint64, QString, bool)), this, SLOT(frame_stored(quint64, QString, bool)));
+  connect(frame_writer, SIGNAL(frame_unchanged(quint64, QString)), this, SLOT(frame_skipped(quint64, QString)));
+  connect(frame_writer, SIGNAL(drained()), this, SLOT(resume_dispatch()));
+  // Initialise the network access manager, once for the life of the camera
+  if (net_acc_manager == 0)
+    net_acc_manager = new QNetworkAccessManager(this);
   // Set up the ip address
   set_ip_address(_ip_address);
   // Set the original positions and speed
@@ -48,182 +93,932 @@ SonySNCRX550N::SonySNCRX550N(const QString& _ip_address, QObject *parent) :
   speed = 24;
   zoom_pos = "oz-1";
   focus_pos = "f-inf";
-  // Move to the position
-  absolute_motion(pan_pos, tilt_pos, speed);
-  absolute_zoom(zoom_pos);
-  absolute_focus(focus_pos);
+  commanded_pose.pan_steps = 0;
+  commanded_pose.tilt_steps = 0;
+  commanded_pose.zoom_code = zoom_code(zoom_pos);
+  commanded_pose.focus_code = focus_code(focus_pos);
+  // Move to the position, otherwise it is read on the first request
+  if (_startup == home_startup)
+    home(speed);
   // Set up the directory where to save the image
   directory_storage = QDir(".");
 }
 
+// The writer threads use the metrics and the change detector, they are
+// stopped before the members go. The stream aborts its reply, it is deleted
+// before the network access manager which owns the reply.
+SonySNCRX550N::~SonySNCRX550N() {
+  delete mjpeg_stream;
+  mjpeg_stream = 0;
+  delete frame_writer;
+}
+
+// Record every request in a trace
+bool SonySNCRX550N::start_trace(const QString& _filename) {
+  stop_trace();
+  QSharedPointer<RequestTraceWriter> writer(new RequestTraceWriter(_filename));
+  if (!writer->open(request_time()))
+    return false;
+  trace = writer;
+  return true;
+}
+
+void SonySNCRX550N::stop_trace() {
+  if (trace.isNull())
+    return;
+  trace->close();
+  trace.clear();
+}
+
+// Kind of a request in the trace, the inquiries belong to their barrier
+RequestTraceRecord::Kind SonySNCRX550N::trace_kind(const RequestKind _kind) {
+  switch (_kind) {
+  case image_request:
+    return RequestTraceRecord::image_kind;
+  case settle_request:
+    return RequestTraceRecord::settle_kind;
+  case stream_request:
+    return RequestTraceRecord::stream_kind;
+  default:
+    return RequestTraceRecord::command_kind;
+  }
+}
+
 // Set the IP address
 void SonySNCRX550N::set_ip_address(const QString& _ip_address) {
   ip_address = _ip_address;
   // Create url for future http request
   url_request_command.setUrl("http://" + ip_address + "/command/ptzf.cgi?");
   url_request_one_shot.setUrl("http://" + ip_address + "/oneshotimage.jpg");
-  // Initialise the network access manager
-  net_acc_manager = new QNetworkAccessManager(this);
+  url_request_inquiry.setUrl("http://" + ip_address + "/command/inquiry.cgi?inq=ptzf");
+  metrics.set_name(ip_address);
+  // The stream follows the camera
+  if (mjpeg_stream != 0)
+    mjpeg_stream->set_ip_address(ip_address);
 }
 
 // Relative motion - The different parameters are given as:
 // _p_angle: pan position  | -360 to 360
 // _t_angle: tilt position |  -96 to 96
 // speed: engine speed     |    1 to 24
-void SonySNCRX550N::relative_motion(const long _p_angle, const long _t_angle, const long _speed) {
+bool SonySNCRX550N::make_relative_motion(const long _p_angle, const long _t_angle, const long _speed, PtzCommand& _command) {
   // Check the speed
   if ((_speed < low_speed) || (_speed > high_speed)) {
     std::cout << "The speed set is out of range !!! Stopping action now!!!" << std::endl;
-    return;
+    return false;
   }
-  QString query = convert_panning_rel_to_hex(_p_angle) + "," + convert_tilt_rel_to_hex(_t_angle) + "," + QString::number(_speed);
-  url_request_command.addQueryItem("relativepantilt", query);
+  _command = PtzCommand();
+  _command.axes = PtzCommand::pan_tilt_axis;
+  _command.relative = true;
+  _command.pose.pan_steps = convert_panning_to_steps(_p_angle, min_panning_rel, max_panning_rel);
+  _command.pose.tilt_steps = convert_tilt_to_steps(_t_angle, min_tilt_rel, max_tilt_rel);
+  _command.speed = static_cast<int> (_speed);
+  return true;
+}
+
+quint64 SonySNCRX550N::relative_motion(const long _p_angle, const long _t_angle, const long _speed) {
+  PtzCommand motion;
+  if (!make_relative_motion(_p_angle, _t_angle, _speed, motion))
+    return 0;
   // Send the request
-  network_request(url_request_command);
+  return command(motion);
 }
 
 // Absolute motion - The different parameters are given as:
 // _p_angle: pan position  | -180 to 180
 // _t_angle: tilt position |  -48 to 48
 // speed: engine speed     |    1 to 24
-void SonySNCRX550N::absolute_motion(const long _p_angle, const long _t_angle, const long _speed) {
+bool SonySNCRX550N::make_absolute_motion(const double _p_angle, const double _t_angle, const long _speed, PtzCommand& _command) {
   // Check the speed
   if ((_speed < low_speed) || (_speed > high_speed)) {
     std::cout << "The speed set is out of range !!! Stopping action now!!!" << std::endl;
-    return;
+    return false;
   }
-  QString query = convert_panning_abs_to_hex(_p_angle) + "," + convert_tilt_abs_to_hex(_t_angle) + "," + QString::number(_speed);
-  url_request_command.addQueryItem("absolutepantilt", query);
+  _command = PtzCommand();
+  _command.axes = PtzCommand::pan_tilt_axis;
+  _command.pose.pan_steps = convert_panning_to_steps(_p_angle, min_panning_abs, max_panning_abs);
+  _command.pose.tilt_steps = convert_tilt_to_steps(_t_angle, min_tilt_abs, max_tilt_abs);
+  _command.speed = static_cast<int> (_speed);
+  return true;
+}
+
+quint64 SonySNCRX550N::absolute_motion(const double _p_angle, const double _t_angle, const long _speed) {
+  PtzCommand motion;
+  if (!make_absolute_motion(_p_angle, _t_angle, _speed, motion))
+    return 0;
   // Send the request
-  network_request(url_request_command);
+  return command(motion);
+}
+
+// Absolute pose - all the axes are moved through a single ptzf.cgi request
+bool SonySNCRX550N::make_absolute_pose(const double _p_angle, const double _t_angle, const QString& _zoom_position, const QString& _focus_position, const long _speed, PtzCommand& _command) {
+  if (!make_absolute_motion(_p_angle, _t_angle, _speed, _command))
+    return false;
+  _command.axes |= PtzCommand::zoom_axis | PtzCommand::focus_axis;
+  _command.pose.zoom_code = PtzCodec::zoom_code(_zoom_position);
+  _command.pose.focus_code = PtzCodec::focus_code(_focus_position);
+  if ((_command.pose.zoom_code == PtzCodec::invalid_code) || (_command.pose.focus_code == PtzCodec::invalid_code)) {
+    std::cout << "The zoom or focus requested is unknown !!! Stopping action now!!!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+quint64 SonySNCRX550N::absolute_pose(const double _p_angle, const double _t_angle, const QString& _zoom_position, const QString& _focus_position, const long _speed) {
+  PtzCommand pose;
+  if (!make_absolute_pose(_p_angle, _t_angle, _zoom_position, _focus_position, _speed, pose))
+    return 0;
+  // Send the request
+  return command(pose);
 }
 
 // Private function in order to control the zoom
-void SonySNCRX550N::absolute_zoom(const QString& _zoom_position) {
-  // Convert the zoom to hexadecimal code
-  auto hexa_zoom = zoom_position_key_to_hex.find(_zoom_position);
-  url_request_command.addQueryItem("absolutezoom", hexa_zoom->second);
+bool SonySNCRX550N::make_absolute_zoom(const QString& _zoom_position, PtzCommand& _command) {
+  _command = PtzCommand();
+  _command.axes = PtzCommand::zoom_axis;
+  _command.pose.zoom_code = PtzCodec::zoom_code(_zoom_position);
+  if (_command.pose.zoom_code == PtzCodec::invalid_code) {
+    std::cout << "The zoom requested is unknown !!! Stopping action now!!!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+quint64 SonySNCRX550N::absolute_zoom(const QString& _zoom_position) {
+  PtzCommand zoom;
+  if (!make_absolute_zoom(_zoom_position, zoom))
+    return 0;
   // Send the request
-  network_request(url_request_command);
+  return command(zoom);
 }
 
 // Private function in order to control the focus
-void SonySNCRX550N::absolute_focus(const QString& _focus_position) {
-  // Convert the focus to hexadecimal code
-  auto hexa_focus = focus_position_key_to_hex.find(_focus_position);
-  url_request_command.addQueryItem("absolutefocus", hexa_focus->second);
+bool SonySNCRX550N::make_absolute_focus(const QString& _focus_position, PtzCommand& _command) {
+  _command = PtzCommand();
+  _command.axes = PtzCommand::focus_axis;
+  _command.pose.focus_code = PtzCodec::focus_code(_focus_position);
+  if (_command.pose.focus_code == PtzCodec::invalid_code) {
+    std::cout << "The focus requested is unknown !!! Stopping action now!!!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+quint64 SonySNCRX550N::absolute_focus(const QString& _focus_position) {
+  PtzCommand focus;
+  if (!make_absolute_focus(_focus_position, focus))
+    return 0;
   // Send the request
-  network_request(url_request_command);
+  return command(focus);
+}
+
+// Queue a command of ptzf.cgi, the query is written in a fixed buffer
+quint64 SonySNCRX550N::command(const PtzCommand& _command) {
+  query_encoder.encode(_command);
+  QUrl url(url_request_command);
+  url.setEncodedQuery(query_encoder.to_byte_array());
+  return network_request(url, command_request, _command);
 }
 
 // Store an image
-void SonySNCRX550N::grab_image() {
-  // Check if the current directory is created
-  network_request(url_request_one_shot);
+quint64 SonySNCRX550N::grab_image() {
+  // Do not shoot while the head is still moving
+  if (settle_before_capture && motion_pending)
+    wait_for_settle();
+  // A frame of the stream saves opening a connection per image
+  if (capture_from_stream && is_streaming())
+    return network_request(QUrl(), stream_request);
+  return network_request(url_request_one_shot, image_request);
+}
+
+// Keep a connection open on /mjpeg
+void SonySNCRX550N::start_stream(const int _fps) {
+  if (mjpeg_stream == 0) {
+    mjpeg_stream = new MjpegStream(net_acc_manager, ip_address, this);
+    connect(mjpeg_stream, SIGNAL(frame_received(quint64)), this, SLOT(stream_frame_received(quint64)));
+    connect(mjpeg_stream, SIGNAL(closed()), this, SLOT(stream_closed()));
+  }
+  update_stream_pose(motion_pending || settle_in_progress);
+  mjpeg_stream->start(_fps);
+}
+
+// Close the stream, the images waiting for it fail
+void SonySNCRX550N::stop_stream() {
+  if (mjpeg_stream == 0)
+    return;
+  mjpeg_stream->stop();
+  stream_closed();
+}
+
+// Tag the next frames of the stream with the cached position
+void SonySNCRX550N::update_stream_pose(const bool _moving) {
+  if (mjpeg_stream != 0)
+    mjpeg_stream->set_pose(pan_pos, tilt_pos, zoom_code(zoom_pos), focus_code(focus_pos), _moving);
+}
+
+// Send the head to its home position
+quint64 SonySNCRX550N::home(const long _speed) {
+  return absolute_pose(0, 0, "oz-1", "f-inf", _speed);
+}
+
+// Queue a barrier which waits for the head to stop
+quint64 SonySNCRX550N::wait_for_settle() {
+  motion_pending = false;
+  return network_request(QUrl(), settle_request);
 }
 
 // Private function for spherical acquisition
 void SonySNCRX550N::spherical_acquisition(const long step_pan, const long step_tilt, const long speed, const QString& _zoom, const QString& _focus, const QString& _directory_storage) {
   // Set the directory for a full acquisition
-  directory_storage = QDir(_directory_storage + "sphere-" + QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+  open_storage(_directory_storage);
+  // Plan the path over the grid and acquire the images
+  execute_scan(scan_planner.plan(ScanPlanner::spherical_grid(step_pan, step_tilt, _zoom, _focus), ScanPose{pan_pos, tilt_pos, zoom_pos, focus_pos}), speed);
+
+  // Move back to the zero position
+  absolute_motion(0, 0, speed);
+}
+
+// Acquisition of the whole sphere with the fewest frames for the zoom
+void SonySNCRX550N::coverage_acquisition(const double _overlap, const long speed, const QString& _zoom, const QString& _focus, const QString& _directory_storage) {
+  std::vector<ScanPose> grid = ScanPlanner::spherical_coverage_grid(_zoom, _focus, _overlap);
+  if (grid.empty()) {
+    std::cout << "The overlap requested is out of range !!! Stopping action now!!!" << std::endl;
+    return;
+  }
+  // Set the directory for a full acquisition
+  open_storage(_directory_storage);
+  // Plan the path over the grid and acquire the images
+  execute_scan(scan_planner.plan(grid, ScanPose{pan_pos, tilt_pos, zoom_pos, focus_pos}), speed);
+}
+
+// Directory of the images grabbed outside of the acquisitions
+void SonySNCRX550N::set_directory_storage(const QString& _directory_storage) {
+  directory_storage = QDir(_directory_storage);
   if (!directory_storage.exists())
     directory_storage.mkpath(".");
-  // Move to the initial position
-  double init_pan_angle = min_panning_abs;
-  double init_tilt_angle = min_tilt_abs;
-  absolute_motion(static_cast<long> (init_pan_angle), static_cast<long> (init_tilt_angle), speed);
-  // Set the zoom
-  absolute_zoom(_zoom);
-  absolute_focus(_focus);
-  grab_image();
-  // Compute the increment for the pan and tilt
-  double angle_pan_inc = total_panning_angle / step_pan;
-  double angle_tilt_inc = total_tilt_angle / step_tilt;
-
-  for (double tilt_angle = init_tilt_angle; tilt_angle <= max_tilt_abs; tilt_angle += angle_tilt_inc) {
-    for (double pan_angle = init_pan_angle; pan_angle <= max_panning_abs; pan_angle += angle_pan_inc) {
-      // Absolute motion
-      absolute_motion(static_cast<long> (pan_angle), static_cast<long> (tilt_angle), speed);
-      // Acquired an image
-      grab_image();
-    }
+  archive_writer.clear();
+}
+
+// Set up the directory or the archive of a new acquisition
+void SonySNCRX550N::open_storage(const QString& _directory_storage) {
+  // The references of the change detector belong to the previous storage
+  change_detector.clear();
+  const QString name = "sphere-" + QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+  if (archive_output) {
+    directory_storage = QDir(_directory_storage);
+    if (!directory_storage.exists())
+      directory_storage.mkpath(".");
+    // The previous archive is closed once its last frame is written
+    archive_writer = QSharedPointer<SphereArchiveWriter> (new SphereArchiveWriter(directory_storage.filePath(name + ".sph")));
+  }
+  else {
+    directory_storage = QDir(_directory_storage + name);
+    if (!directory_storage.exists())
+      directory_storage.mkpath(".");
+    archive_writer.clear();
+  }
+  // Keep track of the poses captured to resume the acquisition
+  const QString journal_path = archive_writer.isNull() ? directory_storage.filePath(journal_filename) : archive_writer->get_filename() + journal_suffix;
+  journal = QSharedPointer<AcquisitionJournal> (new AcquisitionJournal(journal_path));
+  if (!journal->open())
+    journal.clear();
+}
+
+// Pyramid acquisition - higher zoom tiles covering a frame of a coarser level
+void SonySNCRX550N::refine_acquisition(const ScanPose& _parent, const QString& _zoom, const double _overlap, const long speed) {
+  if (PtzCodec::zoom_code(_zoom) == PtzCodec::invalid_code) {
+    std::cout << "The zoom requested is unknown !!! Stopping action now!!!" << std::endl;
+    return;
   }
+  std::vector<ScanPose> grid = ScanPlanner::refinement_grid(_parent, _zoom, _overlap);
+  // The tiles are stored along the coarser level, the zoom is in the filename
+  execute_scan(scan_planner.plan(grid, ScanPose{pan_pos, tilt_pos, zoom_pos, focus_pos}), speed);
+}
+
+// Resume an acquisition stopped before its end
+bool SonySNCRX550N::resume_acquisition(const QString& _sphere, const long speed) {
+  // The journal of an archive is the file next to it
+  const QFileInfo sphere_info(_sphere);
+  const bool archive = sphere_info.exists() && (!sphere_info.isDir());
+  const QString journal_path = archive ? _sphere + journal_suffix : QDir(_sphere).filePath(journal_filename);
+  if (!QFile::exists(journal_path)) {
+    std::cout << "No journal for the sphere given !!! Stopping action now!!!" << std::endl;
+    return false;
+  }
+  QSharedPointer<AcquisitionJournal> previous(new AcquisitionJournal(journal_path));
+  if (!previous->open())
+    return false;
+  // The next images go along the ones already captured, the archive is
+  // extended from its last record
+  if (archive) {
+    QSharedPointer<SphereArchiveWriter> writer(new SphereArchiveWriter(_sphere));
+    if (!writer->is_open())
+      return false;
+    directory_storage = QDir(sphere_info.absolutePath());
+    archive_writer = writer;
+  }
+  else {
+    directory_storage = QDir(_sphere);
+    archive_writer.clear();
+  }
+  journal = previous;
+  const std::vector<ScanPose> missing = journal->get_missing_poses();
+  if (verbose)
+    std::cout << "Resuming the acquisition - " << journal->get_completed_count() << " of " << journal->get_planned_count() << " poses already captured" << std::endl;
+  if (missing.empty())
+    return true;
+  execute_scan(scan_planner.plan(missing, ScanPose{pan_pos, tilt_pos, zoom_pos, focus_pos}), speed);
 
   // Move back to the zero position
   absolute_motion(0, 0, speed);
+  return true;
 }
-void SonySNCRX550N::network_request(const QUrl& _url) {
-  // Get the reply for the url request
-  QNetworkReply* reply = net_acc_manager->get(QNetworkRequest(_url));
-  connect(reply, SIGNAL(finished()), &loop, SLOT(quit()));
-  connect(reply, SIGNAL(finished()), this, SLOT(net_data_transmitted()));
+
+// Visit the poses in the given order and grab an image at each of them
+void SonySNCRX550N::execute_scan(const std::vector<ScanPose>& _poses, const long _speed) {
+  if (_poses.empty())
+    return;
+  ScanPose start = {pan_pos, tilt_pos, zoom_pos, focus_pos};
+  acquisition_predicted_traversal = scan_planner.traversal_time(_poses, start, _speed);
+  acquisition_measured_traversal = 0;
+  acquisition_timer.start();
+  if (verbose)
+    std::cout << "Scan of " << _poses.size() << " poses - predicted traversal time = " << acquisition_predicted_traversal << " s" << std::endl;
+  // The poses are journaled before the first image is requested
+  if (!journal.isNull())
+    journal->plan(_poses);
+  QString current_zoom;
+  QString current_focus;
+  for (auto it = _poses.begin(); it != _poses.end(); ++it) {
+    // The zoom and the focus are only sent when they change
+    if ((it == _poses.begin()) || (it->zoom != current_zoom) || (it->focus != current_focus))
+      absolute_pose(it->pan, it->tilt, it->zoom, it->focus, _speed);
+    else
+      absolute_motion(it->pan, it->tilt, _speed);
+    current_zoom = it->zoom;
+    current_focus = it->focus;
+    // Acquired an image
+    acquisition_last_request = grab_image();
+    if (!journal.isNull()) {
+      JournalEntry entry = {journal, AcquisitionJournal::pose_key(*it)};
+      journal_requests.insert(acquisition_last_request, entry);
+    }
+  }
+}
+
+// Set the maximum number of requests in flight at the same time
+void SonySNCRX550N::set_max_in_flight(const int _max_in_flight) {
+  if (_max_in_flight < 1) {
+    std::cout << "At least one request has to be in flight !!! Keeping the previous value !!!" << std::endl;
+    return;
+  }
+  max_in_flight = _max_in_flight;
+  // More requests may be allowed to leave now
+  dispatch_requests();
+}
+
+// Time given to a request to complete before it is aborted
+void SonySNCRX550N::set_request_timeout(const int _timeout) {
+  if (_timeout < 1) {
+    std::cout << "The request timeout has to be positive !!! Keeping the previous value !!!" << std::endl;
+    return;
+  }
+  request_timeout = _timeout;
+}
+
+// Block the caller until all the queued requests have been processed
+void SonySNCRX550N::wait_for_idle() {
+  if (get_pending_requests() == 0)
+    return;
+  QEventLoop loop;
+  connect(this, SIGNAL(idle()), &loop, SLOT(quit()));
   loop.exec();
 }
 
+// Queue a request and return its identifier
+quint64 SonySNCRX550N::network_request(const QUrl& _url, const RequestKind _kind, const PtzCommand& _command) {
+  // Read the position of the head before the first request - a barrier
+  // takes the position of the camera once settled
+  if ((known_axes != all_axes) && (!position_read_queued)) {
+    position_read_queued = true;
+    if (_kind != settle_request)
+      network_request(QUrl(), settle_request);
+  }
+  CameraRequest request;
+  request.id = ++next_request_id;
+  request.kind = _kind;
+  request.url = _url;
+  request.command = _command;
+  request.directory = directory_storage;
+  request.archive = archive_writer;
+  request.committed = false;
+  request.min_sequence = 0;
+  request.enqueue_time = request_time();
+  request.dispatch_time = 0;
+  request.first_byte_time = 0;
+  request.attempts = 0;
+  request.not_before = 0;
+  request.deadline = 0;
+  if (_kind == command_request)
+    motion_pending = true;
+  if (!trace.isNull())
+    trace->queued(request.id, trace_kind(_kind), _url.path().toLatin1() + '?' + _url.encodedQuery(), _command, request.enqueue_time);
+  request_queue.enqueue(request);
+  dispatch_requests();
+  return request.id;
+}
+
+// Check if a request can be sent given the requests in flight.
+// A command has to wait for every request in flight to be committed, so that
+// the head never moves during a shot and the commands are applied in order.
+// An image or a settle barrier only has to wait for the commands in flight.
+bool SonySNCRX550N::can_dispatch(const CameraRequest& _request) const {
+  if (in_flight_requests.size() >= max_in_flight)
+    return false;
+  // Do not shoot faster than the disk can follow
+  if (((_request.kind == image_request) || (_request.kind == stream_request)) && frame_writer->is_saturated())
+    return false;
+  // The head does not move before the stream delivered the pending shots
+  if ((_request.kind == command_request) && (!stream_waiters.isEmpty()))
+    return false;
+  for (auto it = in_flight_requests.constBegin(); it != in_flight_requests.constEnd(); ++it) {
+    if (it.value().kind == command_request)
+      return false;
+    if ((_request.kind == command_request) && (!it.value().committed))
+      return false;
+  }
+  return true;
+}
+
+// Send the queued requests which are allowed to leave, in order
+void SonySNCRX550N::dispatch_requests() {
+  while ((!settle_in_progress) && (!request_queue.isEmpty()) && can_dispatch(request_queue.head())) {
+    // A request sent again waits for its backoff
+    const qint64 backoff = request_queue.head().not_before - request_time();
+    if (backoff > 0) {
+      retry_timer.start(static_cast<int> ((backoff + 999) / 1000));
+      return;
+    }
+    CameraRequest request = request_queue.dequeue();
+    request.dispatch_time = request_time();
+    metrics.record(RequestMetrics::queue_metric, request.dispatch_time - request.enqueue_time);
+    if (!trace.isNull())
+      trace->dispatched(request.id, request.dispatch_time);
+    // A settle barrier blocks the queue until the head stopped
+    if (request.kind == settle_request) {
+      settle_barrier = request;
+      settle_in_progress = true;
+      stable_readings = 0;
+      // No reading of the camera gives these steps
+      last_ptzf_reading.pan_steps = 0x7FFFFFFF;
+      settle_timer.start();
+      poll_position();
+      return;
+    }
+    // The commands in flight are all completed, the cached pose is the one
+    // of the camera when this request reaches it
+    request.pan_pos = pan_pos;
+    request.tilt_pos = tilt_pos;
+    request.zoom_pos = zoom_pos;
+    request.focus_pos = focus_pos;
+    request.pose_key = PtzCodec::pose_key(commanded_pose);
+    // The image is the first frame which starts arriving from now on
+    if ((request.kind == stream_request) && (!is_streaming())) {
+      request.kind = image_request;
+      request.url = url_request_one_shot;
+    }
+    if (request.kind == stream_request) {
+      const FrameRingBuffer& ring_buffer = mjpeg_stream->get_ring_buffer();
+      const quint64 writing = ring_buffer.get_writing_sequence();
+      request.min_sequence = ((writing != 0) ? writing : ring_buffer.get_latest_sequence()) + 1;
+      request.deadline = request.dispatch_time + static_cast<qint64> (request_timeout) * 1000;
+      stream_waiters.append(request);
+      if (!deadline_timer.isActive())
+	deadline_timer.start(deadline_check_interval);
+      continue;
+    }
+    if (request.kind == command_request)
+      update_stream_pose(true);
+    QNetworkReply* reply = send_request(request);
+    connect(reply, SIGNAL(metaDataChanged()), this, SLOT(net_data_committed()));
+    if (request.kind == command_request)
+      motion_timer.start();
+    emit request_sent(request.id, request.kind == command_request);
+  }
+}
+
+// Send a request to the camera and watch its deadline
+QNetworkReply* SonySNCRX550N::send_request(CameraRequest& _request) {
+  QNetworkRequest net_request(_request.url);
+  // Keep the connection to the camera open between the requests
+  net_request.setRawHeader("Connection", "keep-alive");
+  QNetworkReply* reply = net_acc_manager->get(net_request);
+  connect(reply, SIGNAL(finished()), this, SLOT(net_data_transmitted()));
+  ++_request.attempts;
+  _request.deadline = request_time() + static_cast<qint64> (request_timeout) * 1000;
+  in_flight_requests.insert(reply, _request);
+  if (!deadline_timer.isActive())
+    deadline_timer.start(deadline_check_interval);
+  return reply;
+}
+
+// Errors closing the connection to the camera, the next request opens a new
+// one. The abort of a request past its deadline is not one of them.
+static bool connection_lost(const QNetworkReply::NetworkError _error) {
+  return (_error == QNetworkReply::ConnectionRefusedError) || (_error == QNetworkReply::RemoteHostClosedError) ||
+    (_error == QNetworkReply::HostNotFoundError) || (_error == QNetworkReply::TimeoutError) ||
+    (_error == QNetworkReply::TemporaryNetworkFailureError);
+}
+
+// Queue a failed request again if it can be sent twice. An absolute command
+// gives the same pose when applied twice, an image can be shot again as long
+// as the head did not leave its pose, i.e. before it was committed.
+bool SonySNCRX550N::retry_request(CameraRequest _request, const QNetworkReply::NetworkError _error) {
+  // Sending the request again does not change the answer
+  if ((_error == QNetworkReply::ContentAccessDenied) || (_error == QNetworkReply::ContentOperationNotPermittedError) ||
+      (_error == QNetworkReply::ContentNotFoundError) || (_error == QNetworkReply::AuthenticationRequiredError))
+    return false;
+  if (_request.attempts > max_retries)
+    return false;
+  if ((_request.kind == command_request) && _request.command.relative)
+    return false;
+  if ((_request.kind == image_request) && _request.committed)
+    return false;
+  if ((_request.kind != command_request) && (_request.kind != image_request))
+    return false;
+  const int backoff = retry_backoff << (_request.attempts - 1);
+  _request.committed = false;
+  _request.first_byte_time = 0;
+  _request.enqueue_time = request_time();
+  _request.not_before = _request.enqueue_time + static_cast<qint64> (backoff) * 1000;
+  // Sent again before the requests still queued. A command is alone in
+  // flight and keeps its place, an image may come after the images sent
+  // behind it - they are taken at the same pose.
+  request_queue.prepend(_request);
+  metrics.count_retry();
+  if (verbose)
+    std::cout << "Sending the request again in " << backoff << " ms !!!" << std::endl;
+  return true;
+}
+
+// slot to abort the requests past their deadline
+void SonySNCRX550N::check_deadlines() {
+  const qint64 now = request_time();
+  QList<QNetworkReply*> expired;
+  for (auto it = in_flight_requests.constBegin(); it != in_flight_requests.constEnd(); ++it)
+    if (it.value().deadline <= now)
+      expired.append(it.key());
+  // The stream may stall without closing
+  QList<CameraRequest> stalled;
+  for (int i = 0; i < stream_waiters.size(); ) {
+    if (stream_waiters.at(i).deadline <= now)
+      stalled.append(stream_waiters.takeAt(i));
+    else
+      ++i;
+  }
+  // Aborting a reply finishes it, see net_data_transmitted()
+  for (int i = 0; i < expired.size(); ++i) {
+    if (!in_flight_requests.contains(expired.at(i)))
+      continue;
+    metrics.count_timeout();
+    std::cout << "The camera did not answer in time !!! Aborting the request !!!" << std::endl;
+    expired.at(i)->abort();
+  }
+  for (int i = 0; i < stalled.size(); ++i) {
+    metrics.count_timeout();
+    std::cout << "The stream did not deliver a frame in time !!! The image is lost !!!" << std::endl;
+    request_completed(stalled.at(i).id, false);
+  }
+  if (!stalled.isEmpty())
+    resume_requests();
+  if (in_flight_requests.isEmpty() && stream_waiters.isEmpty())
+    deadline_timer.stop();
+}
+
+// Report the end of a request, and of the running scan with its last image
+void SonySNCRX550N::request_completed(const quint64 _request_id, const bool _success) {
+  metrics.count_request(_success);
+  if (!trace.isNull())
+    trace->completed(_request_id, _success, request_time());
+  // A pose without image is left to the next resume
+  if (!_success)
+    journal_requests.remove(_request_id);
+  emit request_finished(_request_id, _success);
+  if ((acquisition_last_request == 0) || (_request_id != acquisition_last_request))
+    return;
+  acquisition_last_request = 0;
+  const double total_time = acquisition_timer.elapsed() / 1000.0;
+  if (verbose)
+    std::cout << "Scan done - traversal time predicted = " << acquisition_predicted_traversal << " s - measured = " << acquisition_measured_traversal << " s - total = " << total_time << " s" << std::endl;
+  emit acquisition_finished(acquisition_predicted_traversal, acquisition_measured_traversal, total_time);
+}
+
+// slot to report an image once it is on the disk
+void SonySNCRX550N::frame_stored(const quint64 _id, const QString& _filename, const bool _success) {
+  // The pose is captured once its image is on the disk
+  auto it = journal_requests.find(_id);
+  if (it != journal_requests.end()) {
+    if (_success)
+      it.value().journal->complete(it.value().key);
+    journal_requests.erase(it);
+  }
+  if (_success)
+    emit image_grabbed(_id, _filename);
+}
+
+// slot to record an image dropped by the change detector
+void SonySNCRX550N::frame_skipped(const quint64 _id, const QString& _filename) {
+  Q_UNUSED(_filename);
+  // The pose is captured, the image stored at the previous visit stands for it
+  auto it = journal_requests.find(_id);
+  if (it != journal_requests.end()) {
+    it.value().journal->complete(it.value().key);
+    journal_requests.erase(it);
+  }
+  if (verbose)
+    std::cout << "Image unchanged - not stored" << std::endl;
+  emit image_unchanged(_id);
+}
+
+// slot to resume the images once the frame writer caught up
+void SonySNCRX550N::resume_dispatch() {
+  dispatch_requests();
+}
+
+// slot to release the ordering constraint once the camera answers
+void SonySNCRX550N::net_data_committed() {
+  QNetworkReply* _p_net_reply = qobject_cast<QNetworkReply*> (sender());
+  auto it = in_flight_requests.find(_p_net_reply);
+  if (it == in_flight_requests.end())
+    return;
+  if (it.value().first_byte_time == 0) {
+    it.value().first_byte_time = request_time();
+    metrics.record(RequestMetrics::first_byte_metric, it.value().first_byte_time - it.value().dispatch_time);
+  }
+  // Only the images release the ordering constraint before the end
+  if ((it.value().kind != image_request) || (it.value().committed))
+    return;
+  it.value().committed = true;
+  dispatch_requests();
+}
+
 // slot to take decision about the transmitted data
 void SonySNCRX550N::net_data_transmitted() {
   QNetworkReply* _p_net_reply = qobject_cast<QNetworkReply*> (sender());
+  auto it = in_flight_requests.find(_p_net_reply);
+  if (it == in_flight_requests.end())
+    return;
+  const CameraRequest request = it.value();
+  in_flight_requests.erase(it);
+  const QNetworkReply::NetworkError error = _p_net_reply->error();
+  if (connection_lost(error))
+    metrics.count_reconnect();
+  // The position inquiries belong to the settle barrier
+  if (request.kind == inquiry_request) {
+    position_inquired(error == QNetworkReply::NoError, _p_net_reply->readAll());
+    _p_net_reply->deleteLater();
+    return;
+  }
+  const qint64 end_time = request_time();
+  metrics.record(RequestMetrics::transfer_metric, end_time - ((request.first_byte_time != 0) ? request.first_byte_time : request.dispatch_time));
+  metrics.record(RequestMetrics::bytes_metric, static_cast<quint64> (_p_net_reply->bytesAvailable()));
+  if (!trace.isNull())
+    trace->answered(request.id, _p_net_reply->bytesAvailable());
+  const bool success = (error == QNetworkReply::NoError);
+  if (!success) {
+    std::cout << "Request failed: " << _p_net_reply->errorString().toStdString() << std::endl;
+    if (retry_request(request, error)) {
+      _p_net_reply->deleteLater();
+      resume_requests();
+      return;
+    }
+  }
   // If the request was to get an image
-  if (_p_net_reply->url().toString().contains( url_request_one_shot.toString())) {
-    // Get the current time in order to save the image
-    QDateTime current_time = QDateTime::currentDateTimeUtc();
+  else if (request.kind == image_request) {
+    // Read the image in a pooled buffer and let the writer save it
+    QByteArray buffer = frame_writer->acquire_buffer();
+    const qint64 size = _p_net_reply->bytesAvailable();
+    buffer.resize(static_cast<int> (size));
+    const qint64 read_size = _p_net_reply->read(buffer.data(), size);
+    buffer.resize((read_size > 0) ? static_cast<int> (read_size) : 0);
+    store_image(request, buffer, QDateTime::currentDateTimeUtc());
+    if (verbose)
+      std::cout << "Image grabbed" << std::endl;
+  }
+  // Otherwise the request was a command
+  else {
+    update_positions(request.command);
+    update_stream_pose(true);
+    // Without settle barrier, the travel of the running scan ends with the
+    // answer of the command
+    if ((acquisition_last_request != 0) && (!settle_before_capture))
+      acquisition_measured_traversal += motion_timer.elapsed() / 1000.0;
+  }
+  _p_net_reply->deleteLater();
+  request_completed(request.id, success);
+  resume_requests();
+}
+
+// Send the next requests and report when nothing is left
+void SonySNCRX550N::resume_requests() {
+  dispatch_requests();
+  if (get_pending_requests() == 0)
+    emit idle();
+}
+
+// Let the writer store an image taken at the pose of the request
+void SonySNCRX550N::store_image(const CameraRequest& _request, const QByteArray& _buffer, const QDateTime& _time) {
+  // The frames are compared by the pose commanded, which is the same at
+  // each visit, and stored with the pose read
+  const PtzPose pose = {PtzCodec::pan_to_steps(_request.pan_pos), PtzCodec::tilt_to_steps(_request.tilt_pos), zoom_code(_request.zoom_pos), focus_code(_request.focus_pos)};
+  const quint64 pose_key = _request.pose_key;
+  if (!_request.archive.isNull()) {
+    // Index the image by its pose in the archive
+    SphereArchiveEntry entry;
+    entry.pan_steps = static_cast<qint16> (pose.pan_steps);
+    entry.tilt_steps = static_cast<qint16> (pose.tilt_steps);
+    entry.zoom_code = pose.zoom_code;
+    entry.focus_code = pose.focus_code;
+    entry.timestamp = _time.toMSecsSinceEpoch();
+    frame_writer->submit(_request.id, _request.archive, entry, _buffer, change_detection, pose_key);
+  }
+  else {
     // Define the filename - pan position + tilt position + zoom position + focus position + time_of_acquisition
-    QString filename = QString::number(tilt_pos) + "-" + QString::number(pan_pos) + "-" + zoom_pos + "-" + focus_pos + "-" + QDateTime::currentDateTimeUtc().toString(Qt::ISODate) + ".jpg";
-    QFile file(directory_storage.filePath(filename));
-    if (!file.open(QIODevice::WriteOnly)) {
-      std::cout << "Error while writting the image file" << std::endl;
+    QString filename = QString::number(_request.tilt_pos) + "-" + QString::number(_request.pan_pos) + "-" + _request.zoom_pos + "-" + _request.focus_pos + "-" + _time.toString(Qt::ISODate) + ".jpg";
+    frame_writer->submit(_request.id, _request.directory.filePath(filename), _buffer, change_detection, pose_key);
+  }
+}
+
+// slot to answer the image requests waiting for the stream
+void SonySNCRX550N::stream_frame_received(const quint64 _sequence) {
+  if (stream_waiters.isEmpty())
+    return;
+  QList<CameraRequest> answered;
+  for (int i = 0; i < stream_waiters.size(); ) {
+    if (stream_waiters.at(i).min_sequence <= _sequence)
+      answered.append(stream_waiters.takeAt(i));
+    else
+      ++i;
+  }
+  if (answered.isEmpty())
+    return;
+  for (int i = 0; i < answered.size(); ++i) {
+    QByteArray buffer = frame_writer->acquire_buffer();
+    StreamFrameInfo info;
+    const bool success = mjpeg_stream->get_ring_buffer().read(_sequence, buffer, info);
+    if (success && (!trace.isNull()))
+      trace->answered(answered.at(i).id, buffer.size());
+    if (success) {
+      store_image(answered.at(i), buffer, QDateTime::fromMSecsSinceEpoch(info.timestamp).toUTC());
+      if (verbose)
+	std::cout << "Image grabbed from the stream" << std::endl;
+    }
+    else
+      std::cout << "The frame of the stream was overwritten !!! The image is lost !!!" << std::endl;
+    request_completed(answered.at(i).id, success);
+  }
+  resume_requests();
+}
+
+// slot to fail the image requests waiting for a closed stream
+void SonySNCRX550N::stream_closed() {
+  if (stream_waiters.isEmpty())
+    return;
+  const QList<CameraRequest> failed = stream_waiters;
+  stream_waiters.clear();
+  for (int i = 0; i < failed.size(); ++i)
+    request_completed(failed.at(i).id, false);
+  resume_requests();
+}
+
+// slot to send the next position inquiry of the active barrier
+void SonySNCRX550N::poll_position() {
+  if (!settle_in_progress)
+    return;
+  CameraRequest request = settle_barrier;
+  request.kind = inquiry_request;
+  request.url = url_request_inquiry;
+  send_request(request);
+}
+
+// Handle the answer of a position inquiry. The answer is given as
+// AbsolutePTZF=<pan>,<tilt>,<zoom>,<focus>&<parameter>=<value>...
+void SonySNCRX550N::position_inquired(const bool _success, const QByteArray& _answer) {
+  PtzPose reading;
+  if (_success && PtzCodec::parse_ptzf(_answer, reading)) {
+    real_pan_pos = PtzCodec::steps_to_pan(reading.pan_steps);
+    real_tilt_pos = PtzCodec::steps_to_tilt(reading.tilt_steps);
+    real_zoom_code = reading.zoom_code;
+    real_focus_code = reading.focus_code;
+    real_zoom_hex = QString::number(real_zoom_code, 16).toUpper().rightJustified(4, '0');
+    real_focus_hex = QString::number(real_focus_code, 16).toUpper().rightJustified(4, '0');
+    // The head reached the commanded pose, within two motor steps
+    const quint16 target_zoom = PtzCodec::zoom_code(zoom_pos);
+    const quint16 target_focus = PtzCodec::focus_code(focus_pos);
+    // An unknown axis is taken as it is read
+    const bool on_target = ((!(known_axes & PtzCommand::pan_tilt_axis)) ||
+			    ((std::abs(PtzCodec::pan_to_steps(std::remainder(real_pan_pos - pan_pos, PtzCodec::pan_angle))) <= 2) &&
+			     (std::abs(reading.tilt_steps - PtzCodec::tilt_to_steps(tilt_pos)) <= 2))) &&
+      ((!(known_axes & PtzCommand::zoom_axis)) || (target_zoom == PtzCodec::invalid_code) || (target_zoom == real_zoom_code)) &&
+      ((!(known_axes & PtzCommand::focus_axis)) || (target_focus == PtzCodec::invalid_code) || (target_focus == real_focus_code));
+    // Otherwise the readings have to converge, e.g. when the target was clamped
+    if ((reading.pan_steps == last_ptzf_reading.pan_steps) && (reading.tilt_steps == last_ptzf_reading.tilt_steps) &&
+	(reading.zoom_code == last_ptzf_reading.zoom_code) && (reading.focus_code == last_ptzf_reading.focus_code))
+      ++stable_readings;
+    else
+      stable_readings = 0;
+    last_ptzf_reading = reading;
+    if (on_target || (stable_readings >= settle_stable_readings)) {
+      finish_settle(true);
       return;
     }
-    // Save the image
-    file.write(_p_net_reply->readAll());
-    std::cout << "Image grabbed" << std::endl;
-    // Close the file
-    file.close();
-  }
-  else if (_p_net_reply->url().toString().contains("relativepantilt")) {
-    std::cout << "Position moved relatively" << std::endl;
-    QString params = url_request_command.queryItemValue("relativepantilt");
-    QStringList params_split = params.split(",", QString::SkipEmptyParts);
-    double rel_pan = convert_panning_to_deg(params_split.at(0));
-    double rel_tilt = convert_panning_to_deg(params_split.at(1));
-    bool ok;
-    speed = static_cast<long> (params_split.at(2).toInt(&ok, 10));
-    pan_pos = std::fmod((pan_pos + rel_pan), total_panning_angle);
-    tilt_pos += rel_tilt;
+  }
+  if (settle_timer.elapsed() >= settle_timeout) {
+    std::cout << "The camera did not settle in time !!! Resuming the acquisition !!!" << std::endl;
+    finish_settle(false);
+    return;
+  }
+  QTimer::singleShot(settle_poll_interval, this, SLOT(poll_position()));
+}
+
+// Release the barrier and resume the queue
+void SonySNCRX550N::finish_settle(const bool _success) {
+  settle_in_progress = false;
+  if (_success) {
+    // Nothing was commanded on the axes unknown before the reading
+    if (!(known_axes & PtzCommand::pan_tilt_axis)) {
+      commanded_pose.pan_steps = PtzCodec::pan_to_steps(real_pan_pos);
+      commanded_pose.tilt_steps = PtzCodec::tilt_to_steps(real_tilt_pos);
+    }
+    if (!(known_axes & PtzCommand::zoom_axis))
+      commanded_pose.zoom_code = real_zoom_code;
+    if (!(known_axes & PtzCommand::focus_axis))
+      commanded_pose.focus_code = real_focus_code;
+    known_axes = all_axes;
+    // Keep the position reported by the camera
+    pan_pos = real_pan_pos;
+    tilt_pos = real_tilt_pos;
+    const char* key_zoom = PtzCodec::zoom_key(real_zoom_code);
+    if (key_zoom != 0)
+      zoom_pos = QLatin1String(key_zoom);
+    const char* key_focus = PtzCodec::focus_key(real_focus_code);
+    if (key_focus != 0)
+      focus_pos = QLatin1String(key_focus);
+    update_stream_pose(false);
+  }
+  // A failed read is tried again before the next request
+  else if (known_axes != all_axes)
+    position_read_queued = false;
+  // Account for the travel of the running scan
+  if ((acquisition_last_request != 0) && settle_before_capture)
+    acquisition_measured_traversal += motion_timer.elapsed() / 1000.0;
+  metrics.record(RequestMetrics::settle_metric, settle_timer.elapsed() * 1000);
+  emit settled(settle_barrier.id, settle_timer.elapsed());
+  request_completed(settle_barrier.id, _success);
+  resume_requests();
+}
+
+// Update the cached position from a completed command. A single command can
+// move several axes, each one is handled on its own.
+void SonySNCRX550N::update_positions(const PtzCommand& _command) {
+  if ((_command.axes & PtzCommand::pan_tilt_axis) && _command.relative) {
+    if (verbose)
+      std::cout << "Position moved relatively" << std::endl;
+    speed = _command.speed;
+    pan_pos = std::fmod((pan_pos + PtzCodec::steps_to_pan(_command.pose.pan_steps)), PtzCodec::pan_angle);
+    tilt_pos += PtzCodec::steps_to_tilt(_command.pose.tilt_steps);
     if (tilt_pos > max_tilt_abs)
       tilt_pos = max_tilt_abs;
     else if (tilt_pos < min_tilt_abs)
       tilt_pos = min_tilt_abs;
-    std::cout << "Pan angle = " << pan_pos << " - Tilt angle = " << tilt_pos << " - Zoom angle = " << zoom_pos.toStdString() << " - Focus angle = " << focus_pos.toStdString() << std::endl;
-    // Remove the url query from the list
-    url_request_command.removeQueryItem("relativepantilt");
-  }
-  else if (_p_net_reply->url().toString().contains("absolutepantilt")) {
-    QString params = url_request_command.queryItemValue("absolutepantilt");
-    QStringList params_split = params.split(",", QString::SkipEmptyParts);
-    pan_pos = convert_panning_to_deg(params_split.at(0));
-    tilt_pos = convert_panning_to_deg(params_split.at(1));
-    bool ok;
-    speed = static_cast<long> (params_split.at(2).toInt(&ok, 10));
-    std::cout << "Pan angle = " << pan_pos << " - Tilt angle = " << tilt_pos << " - Zoom angle = " << zoom_pos.toStdString() << " - Focus angle = " << focus_pos.toStdString() << std::endl;
-    // Remove the url query from the list
-    url_request_command.removeQueryItem("absolutepantilt");
+    commanded_pose.pan_steps = PtzCodec::pan_to_steps(pan_pos);
+    commanded_pose.tilt_steps = PtzCodec::tilt_to_steps(tilt_pos);
   }
-  else if (_p_net_reply->url().toString().contains("absolutezoom")) {
-    auto key_zoom = zoom_position_hex_to_key.find(url_request_command.queryItemValue("absolutezoom"));
-    zoom_pos = key_zoom->second;
-    std::cout << "Pan angle = " << pan_pos << " - Tilt angle = " << tilt_pos << " - Zoom angle = " << zoom_pos.toStdString() << " - Focus angle = " << focus_pos.toStdString() << std::endl;
-    // Remove the url query from the list
-    url_request_command.removeQueryItem("absolutezoom");
+  else if (_command.axes & PtzCommand::pan_tilt_axis) {
+    speed = _command.speed;
+    pan_pos = PtzCodec::steps_to_pan(_command.pose.pan_steps);
+    tilt_pos = PtzCodec::steps_to_tilt(_command.pose.tilt_steps);
+    commanded_pose.pan_steps = _command.pose.pan_steps;
+    commanded_pose.tilt_steps = _command.pose.tilt_steps;
+    // The head is where it was sent
+    known_axes |= PtzCommand::pan_tilt_axis;
   }
-  else if (_p_net_reply->url().toString().contains("absolutefocus")) {
-    auto key_focus = focus_position_hex_to_key.find(url_request_command.queryItemValue("absolutefocus"));
-    focus_pos = key_focus->second;
-    std::cout << "Pan angle = " << pan_pos << " - Tilt angle = " << tilt_pos << " - Zoom angle = " << zoom_pos.toStdString() << " - Focus angle = " << focus_pos.toStdString() << std::endl;
-    // Remove the url query from the list
-    url_request_command.removeQueryItem("absolutefocus");
+  if (_command.axes & PtzCommand::zoom_axis) {
+    commanded_pose.zoom_code = _command.pose.zoom_code;
+    known_axes |= PtzCommand::zoom_axis;
+    const char* key_zoom = PtzCodec::zoom_key(_command.pose.zoom_code);
+    if (key_zoom != 0)
+      zoom_pos = QLatin1String(key_zoom);
   }
-  _p_net_reply->deleteLater();
+  if (_command.axes & PtzCommand::focus_axis) {
+    commanded_pose.focus_code = _command.pose.focus_code;
+    known_axes |= PtzCommand::focus_axis;
+    const char* key_focus = PtzCodec::focus_key(_command.pose.focus_code);
+    if (key_focus != 0)
+      focus_pos = QLatin1String(key_focus);
+  }
+  if (verbose)
+    std::cout << "Pan angle = " << pan_pos << " - Tilt angle = " << tilt_pos << " - Zoom angle = " << zoom_pos.toStdString() << " - Focus angle = " << focus_pos.toStdString() << std::endl;
 }
 
 void SonySNCRX550N::delay(int _delay) {
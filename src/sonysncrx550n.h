@@ -35,6 +35,22 @@
 #include <QNetworkAccessManager>
 #include <QEventLoop>
 #include <QDir>
+#include <QQueue>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QSharedPointer>
+#include <QDateTime>
+#include <QList>
+#include <QTimer>
+
+#include "acquisitionjournal.h"
+#include "changedetector.h"
+#include "ptzcodec.h"
+#include "scanplanner.h"
+#include "framewriter.h"
+#include "mjpegstream.h"
+#include "requestmetrics.h"
+#include "requesttrace.h"
 
 class SonySNCRX550N : public QObject
 {
@@ -43,47 +59,197 @@ class SonySNCRX550N : public QObject
   /* PUBLIC MEMBERS AND FUNCTIONS */
 
 public:
-  // Constructor
-  explicit SonySNCRX550N(const QString& _ip_address, QObject *parent = 0);
+  // What the camera does when the driver is created:
+  //   - home_startup: the head is sent to pan 0, tilt 0, oz-1 and f-inf
+  //   - lazy_startup: nothing is sent, the position of the head is read
+  //     through inquiry.cgi before the first request leaves
+  enum StartupMode { home_startup, lazy_startup };
+
+  // Constructor - the cameras of a fleet share the network access manager
+  // given, otherwise the camera owns its own one. The constructor returns
+  // without waiting for the camera in both modes.
+  explicit SonySNCRX550N(const QString& _ip_address, QObject *parent = 0, QNetworkAccessManager* _net_acc_manager = 0, const StartupMode _startup = home_startup);
+  // Destructor - the images queued are written before the camera goes
+  ~SonySNCRX550N();
 
   /* Network management */
   // Create a function to set up the camera to a new IP address
   void set_ip_address(const QString& _ip_adress);
+  inline QString get_ip_address() const { return ip_address; }
+
+  /* Command engine */
+  // The commands are queued and sent asynchronously. Each command returns
+  // an identifier which is reported back through request_finished().
+  // Set the maximum number of requests in flight at the same time
+  void set_max_in_flight(const int _max_in_flight);
+  inline int get_max_in_flight() const { return max_in_flight; }
+  // Number of requests queued or in flight
+  inline int get_pending_requests() const { return request_queue.size() + in_flight_requests.size() + stream_waiters.size() + (settle_in_progress ? 1 : 0); }
+  // Block the caller until all the queued requests have been processed
+  void wait_for_idle();
+  // Time given to a request to complete before it is aborted, in ms
+  void set_request_timeout(const int _timeout);
+  inline int get_request_timeout() const { return request_timeout; }
+  // A failed command or image is sent again up to _retries times, after a
+  // delay doubling from _backoff ms. The relative motions are never sent
+  // twice since they would move the head twice.
+  inline void set_max_retries(const int _retries) { max_retries = (_retries < 0) ? 0 : _retries; }
+  inline int get_max_retries() const { return max_retries; }
+  inline void set_retry_backoff(const int _backoff) { retry_backoff = (_backoff < 0) ? 0 : _backoff; }
+  inline int get_retry_backoff() const { return retry_backoff; }
+
+  /* Instrumentation */
+  // Latency of every request, see RequestMetrics::start_export() to dump
+  // them periodically
+  inline RequestMetrics& get_metrics() { return metrics; }
+  // Record every request in a trace, see RequestTraceReplayer to replay it.
+  // A trace already running is closed first.
+  bool start_trace(const QString& _filename);
+  void stop_trace();
+  inline bool is_tracing() const { return !trace.isNull(); }
+  // Print the progress of the requests on the console
+  inline void set_verbose(const bool _verbose) { verbose = _verbose; }
+  inline bool get_verbose() const { return verbose; }
 
   /* Command management */
   // Relative motion - The different parameters are given as:
   // _p_angle: pan position  | -360 to 360
   // _t_angle: tilt position |  -96 to 96
   // speed: engine speed     |    1 to 24
-  void relative_motion(const long _p_angle = 0, const long _t_angle = 0, const long _speed = 0);
+  quint64 relative_motion(const long _p_angle = 0, const long _t_angle = 0, const long _speed = 0);
   
   // Absolute motion - The different parameters are given as:
   // _p_angle: pan position  | -180 to 180
   // _t_angle: tilt position |  -48 to 48
   // speed: engine speed     |    1 to 24
-  void absolute_motion(const long _p_angle = 0, const long _t_angle = 0, const long _speed = 0);
+  quint64 absolute_motion(const double _p_angle = 0, const double _t_angle = 0, const long _speed = 0);
 
-  // Function to get the position of the camera
+  // Absolute pose - pan, tilt, zoom and focus are sent in a single request:
+  // _p_angle: pan position  | -180 to 180
+  // _t_angle: tilt position |  -48 to 48
+  // _zoom_position: zoom    | oz-{1 ... 25} or dz-{1 ... 12}
+  // _focus_position: focus  | f-{inf ... 35}
+  // speed: engine speed     |    1 to 24
+  quint64 absolute_pose(const double _p_angle = 0, const double _t_angle = 0, const QString& _zoom_position = "oz-1", const QString& _focus_position = "f-inf", const long _speed = 24);
+
+  // Send the head to pan 0, tilt 0, oz-1 and f-inf
+  quint64 home(const long _speed = 24);
+
+  // Function to get the position of the camera - with lazy_startup, the
+  // position is the home one until the camera was read
   inline void get_camera_positions(double& _pan_pos, double& _tilt_pos, QString& _zoom_pos, QString& _focus_pos) const { _pan_pos = pan_pos; _tilt_pos = tilt_pos; _zoom_pos = zoom_pos; _focus_pos = focus_pos; }
   inline double get_pan_position() const { return pan_pos; }
   inline double get_tilt_position() const { return tilt_pos; }
   inline QString get_zoom_position() const { return zoom_pos; }
   inline QString get_focus_position() const { return focus_pos; }
+  // False until the position of every axis of the head is read by a settle
+  // barrier or set by an absolute command
+  inline bool is_position_known() const { return known_axes == all_axes; }
+
+  /* Motion settling */
+  // Queue a barrier which polls the real position of the camera through
+  // inquiry.cgi and releases the following requests once the head stopped.
+  // settled() is emitted with the identifier returned.
+  quint64 wait_for_settle();
+  // Gate every image on a settle barrier when the head was moved before
+  inline void set_settle_before_capture(const bool _settle) { settle_before_capture = _settle; }
+  inline bool get_settle_before_capture() const { return settle_before_capture; }
+  // Interval between two inquiries and maximum time to wait, in ms
+  inline void set_settle_poll_interval(const int _interval) { settle_poll_interval = _interval; }
+  inline void set_settle_timeout(const int _timeout) { settle_timeout = _timeout; }
+  // Last position reported by the camera itself
+  inline void get_real_positions(double& _pan_pos, double& _tilt_pos, QString& _zoom_hex, QString& _focus_hex) const { _pan_pos = real_pan_pos; _tilt_pos = real_tilt_pos; _zoom_hex = real_zoom_hex; _focus_hex = real_focus_hex; }
 
   /* Camera management */
   // Private function in order to control the optical zoom
-  void absolute_zoom(const QString& _zoom_position = "oz-1");
+  quint64 absolute_zoom(const QString& _zoom_position = "oz-1");
 
   // Private function in order to control the optical zoom
-  void absolute_focus(const QString& _focus_position = "f-200");
-
-  // Private function to store an image
-  void grab_image();
+  quint64 absolute_focus(const QString& _focus_position = "f-200");
+
+  // Private function to store an image - gated on the motion settling
+  quint64 grab_image();
+
+  /* Video stream */
+  // Keep a connection open on /mjpeg and receive the frames in a ring
+  // buffer, _fps = 0 for the fastest rate of the camera
+  void start_stream(const int _fps = 0);
+  void stop_stream();
+  inline bool is_streaming() const { return (mjpeg_stream != 0) && mjpeg_stream->is_running(); }
+  // Stream of the camera, 0 before start_stream() - the frames are tagged
+  // with the position of the camera and can be read from any thread
+  inline MjpegStream* get_stream() { return mjpeg_stream; }
+  // Take the images from the stream instead of oneshotimage.jpg while it
+  // runs - the first frame received after the head settled is stored
+  inline void set_capture_from_stream(const bool _from_stream) { capture_from_stream = _from_stream; }
+  inline bool get_capture_from_stream() const { return capture_from_stream; }
 
   /* Computer Vision */
-  // Private function for spherical acquisition - TODO IMPLEMENT ZOOM AND FOCUS
+  // Private function for spherical acquisition on a fixed grid, the zoom is
+  // not taken into account - see coverage_acquisition()
+  // The poses are queued and the function returns immediately, see idle()
   void spherical_acquisition(const long step_pan = 18, const long step_tilt = 8, const long speed = 24, const QString& _zoom = "oz-1", const QString& _focus = "f-inf", const QString& _directory_storage = "./");
 
+  // Acquisition of the whole sphere with the fewest frames - the grid is
+  // derived from the field of view of the zoom and the requested overlap:
+  // _overlap: overlap between neighbouring frames in percent | 0 to 90
+  void coverage_acquisition(const double _overlap = 20.0, const long speed = 24, const QString& _zoom = "oz-1", const QString& _focus = "f-inf", const QString& _directory_storage = "./");
+
+  // Pyramid acquisition - grab the tiles at a higher zoom covering the frame
+  // of a coarser level taken at _parent, in the directory of the last
+  // acquisition
+  void refine_acquisition(const ScanPose& _parent, const QString& _zoom, const double _overlap = 20.0, const long speed = 24);
+
+  // Resume an acquisition stopped before its end - the journal of the sphere
+  // directory or archive gives the poses planned whose image is not on the
+  // disk, only those are captured again. Returns false without journal.
+  bool resume_acquisition(const QString& _sphere, const long speed = 24);
+
+  // Visit the poses in the given order and grab an image at each of them.
+  // acquisition_finished() reports the predicted and measured traversal time.
+  void execute_scan(const std::vector<ScanPose>& _poses, const long _speed = 24);
+
+  // Planner ordering the poses of the acquisitions
+  inline ScanPlanner& get_scan_planner() { return scan_planner; }
+
+  // Pool of threads writing the images on the disk
+  inline FrameWriter* get_frame_writer() { return frame_writer; }
+
+  // Store the next acquisitions in a single sphere-<date>.sph archive instead
+  // of a directory of images - see SphereArchiveReader
+  inline void set_archive_output(const bool _archive) { archive_output = _archive; }
+  inline bool get_archive_output() const { return archive_output; }
+  // Directory of the images grabbed outside of the acquisitions, created if
+  // needed - the current one by default
+  void set_directory_storage(const QString& _directory_storage);
+
+  // Patrol mode - an image barely different from the last one stored at its
+  // pose is not stored, image_unchanged() is emitted instead of
+  // image_grabbed(). See ChangeDetector for the threshold and the counters.
+  inline void set_change_detection(const bool _detection) { change_detection = _detection; }
+  inline bool get_change_detection() const { return change_detection; }
+  inline ChangeDetector& get_change_detector() { return change_detector; }
+
+  /* Typed commands */
+  // Build the commands sent by the functions above, with the same ranges -
+  // false when the speed, the zoom or the focus is invalid
+  static bool make_relative_motion(const long _p_angle, const long _t_angle, const long _speed, PtzCommand& _command);
+  static bool make_absolute_motion(const double _p_angle, const double _t_angle, const long _speed, PtzCommand& _command);
+  static bool make_absolute_pose(const double _p_angle, const double _t_angle, const QString& _zoom_position, const QString& _focus_position, const long _speed, PtzCommand& _command);
+  static bool make_absolute_zoom(const QString& _zoom_position, PtzCommand& _command);
+  static bool make_absolute_focus(const QString& _focus_position, PtzCommand& _command);
+  // Queue a command of ptzf.cgi
+  quint64 command(const PtzCommand& _command);
+
+  /* Position codes */
+  // Conversion between the zoom and focus positions and the codes sent to the
+  // camera - an unknown position gives 0xFFFF, an unknown code its hexadecimal
+  // - see PtzCodec
+  static quint16 zoom_code(const QString& _zoom_position);
+  static quint16 focus_code(const QString& _focus_position);
+  static QString zoom_key(const quint16 _zoom_code);
+  static QString focus_key(const quint16 _focus_code);
+
   /* PRIVATE MEMBERS AND FUNCTIONS */
 
 private:
@@ -93,13 +259,126 @@ private:
   QString ip_address;
   // Private member for network access manager
   QNetworkAccessManager* net_acc_manager;
-  QEventLoop loop;
+
+  /* Command engine */
+  // Kind of request handled by the command engine
+  enum RequestKind { command_request, image_request, settle_request, inquiry_request, stream_request };
+  // Request waiting in the queue or in flight
+  struct CameraRequest {
+    quint64 id;
+    RequestKind kind;
+    QUrl url;
+    // Directory or archive where an image has to be stored
+    QDir directory;
+    QSharedPointer<SphereArchiveWriter> archive;
+    // Position of the camera when the request was sent
+    double pan_pos;
+    double tilt_pos;
+    QString zoom_pos;
+    QString focus_pos;
+    // Key of the pose commanded, compared by the change detector
+    quint64 pose_key;
+    // An image request is committed as soon as the camera starts answering,
+    // meaning that the shot is taken and the head can move again
+    bool committed;
+    // Axes moved by a command
+    PtzCommand command;
+    // First frame of the stream which can answer a stream request
+    quint64 min_sequence;
+    // Time of the queueing, the sending and the first byte of the answer,
+    // in us on the request clock
+    qint64 enqueue_time;
+    qint64 dispatch_time;
+    qint64 first_byte_time;
+    // Number of times the request was sent, the request does not leave
+    // before not_before and is aborted after deadline, in us
+    int attempts;
+    qint64 not_before;
+    qint64 deadline;
+  };
+  QQueue<CameraRequest> request_queue;
+  QHash<QNetworkReply*, CameraRequest> in_flight_requests;
+  int max_in_flight;
+  quint64 next_request_id;
+  static const int default_max_in_flight = 4;
+  // Private members regarding the failures
+  int request_timeout;
+  int max_retries;
+  int retry_backoff;
+  static const int default_request_timeout = 10000;
+  static const int default_max_retries = 3;
+  static const int default_retry_backoff = 200;
+  // Watchdog aborting the requests past their deadline
+  QTimer deadline_timer;
+  static const int deadline_check_interval = 100;
+  // Wake up the queue when a retried request may leave
+  QTimer retry_timer;
+
+  /* Instrumentation */
+  RequestMetrics metrics;
+  QElapsedTimer request_clock;
+  bool verbose;
+  inline qint64 request_time() const { return request_clock.nsecsElapsed() / 1000; }
+  // Trace of the requests, if any
+  QSharedPointer<RequestTraceWriter> trace;
+  static RequestTraceRecord::Kind trace_kind(const RequestKind _kind);
 
   // Private function in order to make network requests
-  void network_request(const QUrl& _url);
+  quint64 network_request(const QUrl& _url, const RequestKind _kind = command_request, const PtzCommand& _command = PtzCommand());
+  // Send the queued requests which are allowed to leave
+  void dispatch_requests();
+  // Update the cached position from a completed command
+  void update_positions(const PtzCommand& _command);
+  // Check if a request can be sent given the requests in flight
+  bool can_dispatch(const CameraRequest& _request) const;
+  // Report the end of a request
+  void request_completed(const quint64 _request_id, const bool _success);
+  // Send the next requests and report when nothing is left
+  void resume_requests();
+  // Send a request to the camera on a kept-alive connection
+  QNetworkReply* send_request(CameraRequest& _request);
+  // Queue a failed request again if it can be sent twice
+  bool retry_request(CameraRequest _request, const QNetworkReply::NetworkError _error);
+
+  /* Motion settling */
+  // Private member regarding the position inquiry
+  QUrl url_request_inquiry;
+  bool settle_before_capture;
+  // A move was queued since the last settle barrier
+  bool motion_pending;
+  int settle_poll_interval;
+  int settle_timeout;
+  static const int default_settle_poll_interval = 50;
+  static const int default_settle_timeout = 10000;
+  // Number of identical answers meaning that the head stopped off target
+  int stable_readings;
+  static const int settle_stable_readings = 3;
+  // Barrier being processed
+  bool settle_in_progress;
+  CameraRequest settle_barrier;
+  QElapsedTimer settle_timer;
+  // Axes whose cached position is the one of the camera, otherwise a barrier
+  // reading it is queued before the next request, until a read succeeds
+  int known_axes;
+  static const int all_axes = PtzCommand::pan_tilt_axis | PtzCommand::zoom_axis | PtzCommand::focus_axis;
+  bool position_read_queued;
+  // Previous answer of the camera, the head stopped when it does not change
+  PtzPose last_ptzf_reading;
+  // Position reported by the camera
+  double real_pan_pos;
+  double real_tilt_pos;
+  QString real_zoom_hex;
+  QString real_focus_hex;
+  quint16 real_zoom_code;
+  quint16 real_focus_code;
+
+  // Handle the answer of a position inquiry
+  void position_inquired(const bool _success, const QByteArray& _answer);
+  // Release the barrier and resume the queue
+  void finish_settle(const bool _success);
 
   /* Command management */
-  // Private member regarding engine command
+  // Private member regarding engine command - base url, never modified
   QUrl url_request_command;
 
   // Private member for the position of the camera
@@ -107,145 +386,138 @@ private:
   double tilt_pos;
   QString zoom_pos;
   QString focus_pos;
+  // Pose sent to the camera - the settle barriers keep the position read,
+  // up to the on-target tolerance away from it
+  PtzPose commanded_pose;
 
   // Private members regarding the speed
   long speed;
   static const long low_speed = 1;
   static const long high_speed = 24;
 
-  // Private parameter regarding the panning
-  static const long number_panning_steps = 16320;
-  static constexpr double total_panning_angle = 360.0;
+  // Private parameter regarding the panning - see PtzCodec for the steps
   static constexpr double min_panning_rel = -360.0;
   static constexpr double max_panning_rel = 360.0;
   static constexpr double min_panning_abs = -180.0;
   static constexpr double max_panning_abs = 180.0;
 
-  // RELATIVE CASE - PAN
-  // Degree to hexadecimal
-  inline QString convert_panning_rel_to_hex(const double _p_angle) const {
-    if ((_p_angle < min_panning_rel)||(_p_angle > max_panning_rel)) {
-      std::cout << "The pan angle requested is to small or to large!!! The camera will not move !!!" << std::endl;
-      QString tmp = QString::number(0, 16).toUpper();      
-      if (tmp.length() > 4)
-	return tmp.mid(tmp.length() - 4, 4);
-      else
-	return tmp;
-    }    
-    QString tmp = QString::number(static_cast<long> (std::round(_p_angle * static_cast<double> (number_panning_steps) / total_panning_angle)), 16).toUpper();
-    if (tmp.length() > 4)
-      return tmp.mid(tmp.length() - 4, 4);
-    else
-      return tmp;
-  }
-
-  // ABSOLUTE CASE - PAN
-  // Degree to hexadecimal
-  inline QString convert_panning_abs_to_hex(const double _p_angle) const {
-    if ((_p_angle < min_panning_abs)||(_p_angle > max_panning_abs)) {
-      std::cout << "The pan angle requested is to small or to large!!! The camera will not move !!!" << std::endl;
-      return QString::number(0, 16).toUpper();
-      QString tmp = QString::number(0, 16).toUpper();      
-      if (tmp.length() > 4)
-	return tmp.mid(tmp.length() - 4, 4);
-      else
-	return tmp;
-    }
-    QString tmp = QString::number(static_cast<long> (std::round(_p_angle * static_cast<double> (number_panning_steps) / total_panning_angle)), 16).toUpper();
-    if (tmp.length() > 4) {
-      return tmp.mid(tmp.length() - 4, 4);;
-    }
-    else
-      return tmp;
-  }
-  
-  // Hexadecimal to degree
-  inline double convert_panning_to_deg(const QString _p_hexa) const {
-    // Convert hexadecimal to decimal steps
-    short int dec_steps = std::stoul(_p_hexa.toStdString(), nullptr, 16);
-    // Convert the steps to degree
-    return (static_cast<double> (dec_steps) * total_panning_angle / static_cast<double> (number_panning_steps));
-  }
-
   // Private parameter regarding the tilting
-  static const long number_tilt_steps = 4352;
-  static constexpr double total_tilt_angle = 96.0;
   static constexpr double min_tilt_rel = -96.0;
   static constexpr double max_tilt_rel = 96.0;
   static constexpr double min_tilt_abs = -48.0;
   static constexpr double max_tilt_abs = 48.0;
 
-  // RELATIVE CASE - TILT
-  // Degree to hexadecimal
-  inline QString convert_tilt_rel_to_hex(const double _t_angle) const {
-    if ((_t_angle < min_tilt_rel)||(_t_angle > max_tilt_rel)) {
+  // Degree to motor steps, an angle out of range gives 0
+  static inline qint32 convert_panning_to_steps(const double _p_angle, const double _min, const double _max) {
+    if ((_p_angle < _min)||(_p_angle > _max)) {
       std::cout << "The pan angle requested is to small or to large!!! The camera will not move !!!" << std::endl;
-      QString tmp = QString::number(0, 16).toUpper();      
-      if (tmp.length() > 4)
-	return tmp.mid(tmp.length() - 4, 4);
-      else
-	return tmp;
+      return 0;
     }
-    QString tmp = QString::number(static_cast<long> (std::round(_t_angle * static_cast<double> (number_tilt_steps) / total_tilt_angle)), 16).toUpper();
-    if (tmp.length() > 4)
-      return tmp.mid(tmp.length() - 4, 4);
-    else
-      return tmp;
+    return PtzCodec::pan_to_steps(_p_angle);
   }
-
-  // ABSOLUTE CASE - TILT
-  // Degree to hexadecimal
-  inline QString convert_tilt_abs_to_hex(const double _t_angle) const {
-    if ((_t_angle < min_tilt_abs)||(_t_angle > max_tilt_abs)) {
-      std::cout << "The pan angle requested is to small or to large!!! The camera will not move !!!" << std::endl;
-      QString tmp = QString::number(0, 16).toUpper();      
-      if (tmp.length() > 4)
-	return tmp.mid(tmp.length() - 4, 4);
-      else
-	return tmp;
+  static inline qint32 convert_tilt_to_steps(const double _t_angle, const double _min, const double _max) {
+    if ((_t_angle < _min)||(_t_angle > _max)) {
+      std::cout << "The tilt angle requested is to small or to large!!! The camera will not move !!!" << std::endl;
+      return 0;
     }
-    QString tmp = QString::number(static_cast<long> (std::round(_t_angle * static_cast<double> (number_tilt_steps) / total_tilt_angle)), 16).toUpper();
-    if (tmp.length() > 4)
-      return tmp.mid(tmp.length() - 4, 4);
-    else
-      return tmp;
+    return PtzCodec::tilt_to_steps(_t_angle);
   }
 
-  // Hexadecimal to degree
-  inline double convert_tilt_to_deg(const QString _p_hexa) const {
-    // Convert hexadecimal to decimal steps
-    short int dec_steps = std::stoul(_p_hexa.toStdString(), nullptr, 16);
-    // Convert the steps to degree
-    return (static_cast<double> (dec_steps) * total_tilt_angle / static_cast<double> (number_tilt_steps));
-  }
+  // Query of the commands, written without allocation
+  PtzQueryEncoder query_encoder;
+
+  /* Scan management */
+  ScanPlanner scan_planner;
+  // Last request of the running scan, 0 when no scan is running
+  quint64 acquisition_last_request;
+  double acquisition_predicted_traversal;
+  double acquisition_measured_traversal;
+  QElapsedTimer acquisition_timer;
+  // Started when a command leaves, read when the head settled, or when the
+  // command is answered if the captures do not wait for the settling
+  QElapsedTimer motion_timer;
 
   /* Camera management */
   // Private member regarding camera shot
   QUrl url_request_one_shot;
   QDir directory_storage;
-
-  // DEFINE IN THE CPP FILE
-  // Private member about the camera zoom
-  // The input can be:
-  //   - optical zoom - oz-{1 ... 26}
-  //   - digital zoom - dz-{1 ... 12}
-  static const std::map< QString, QString > zoom_position_key_to_hex;
-  // Declare the opposit search
-  static const std::map< QString, QString > zoom_position_hex_to_key;
-
-  // Private member about the camera focus
-  // The input can be:
-  //   - focus - f-{inf ... 35} in mm
-  static const std::map< QString, QString > focus_position_key_to_hex;
-  // Declare the opposit search
-  static const std::map< QString, QString > focus_position_hex_to_key;
+  // Private member writing the images out of the event loop
+  FrameWriter* frame_writer;
+  // Private member regarding the archive of the current acquisition
+  bool archive_output;
+  QSharedPointer<SphereArchiveWriter> archive_writer;
+  // Private members regarding the patrol mode, the detector runs on the
+  // threads of the writer
+  bool change_detection;
+  ChangeDetector change_detector;
+
+  // Private member regarding the journal of the acquisition, written in the
+  // directory of images or next to the archive
+  QSharedPointer<AcquisitionJournal> journal;
+  // Pose of each image request of the journal, completed once on the disk
+  struct JournalEntry {
+    QSharedPointer<AcquisitionJournal> journal;
+    quint64 key;
+  };
+  QHash<quint64, JournalEntry> journal_requests;
+  static const char* const journal_filename;
+  static const char* const journal_suffix;
+
+  // Set up the directory or the archive of a new acquisition
+  void open_storage(const QString& _directory_storage);
+  // Let the writer store an image taken at the pose of the request
+  void store_image(const CameraRequest& _request, const QByteArray& _buffer, const QDateTime& _time);
+
+  /* Video stream */
+  MjpegStream* mjpeg_stream;
+  bool capture_from_stream;
+  // Image requests waiting for a frame of the stream
+  QList<CameraRequest> stream_waiters;
+  // Tag the next frames of the stream with the cached position
+  void update_stream_pose(const bool _moving);
 
   // Function to add some delay if needed sometimes
   void delay(int _delay);
 
+signals:
+  // Emitted when a request leaves for the camera, _command is set for the
+  // motion, zoom and focus commands
+  void request_sent(const quint64 _request_id, const bool _command);
+  // Emitted when a request is completed
+  void request_finished(const quint64 _request_id, const bool _success);
+  // Emitted when an image has been stored
+  void image_grabbed(const quint64 _request_id, const QString& _filename);
+  // Emitted when an image is not stored since its pose did not change
+  void image_unchanged(const quint64 _request_id);
+  // Emitted when a settle barrier is released, with the time spent in ms
+  void settled(const quint64 _request_id, const qint64 _settle_time);
+  // Emitted at the end of a scan with the predicted and measured traversal
+  // time and the total time of the scan, in seconds
+  void acquisition_finished(const double _predicted_traversal, const double _measured_traversal, const double _total_time);
+  // Emitted when no request is queued or in flight anymore
+  void idle();
+
 public slots:
   // slot to take decision about the transmitted data
   void net_data_transmitted();
+
+private slots:
+  // slot to release the ordering constraint once the camera answers
+  void net_data_committed();
+  // slot to send the next position inquiry of the active barrier
+  void poll_position();
+  // slot to report an image once it is on the disk
+  void frame_stored(const quint64 _id, const QString& _filename, const bool _success);
+  // slot to record an image dropped by the change detector
+  void frame_skipped(const quint64 _id, const QString& _filename);
+  // slot to resume the images once the frame writer caught up
+  void resume_dispatch();
+  // slot to answer the image requests waiting for the stream
+  void stream_frame_received(const quint64 _sequence);
+  // slot to fail the image requests waiting for a closed stream
+  void stream_closed();
+  // slot to abort the requests past their deadline
+  void check_deadlines();
 };
 
 #endif  // SONYSNCRX550N_H_
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "spherearchive.h"
+#include "ptzcodec.h"
+
+// qt library
+#include <QDateTime>
+#include <QDir>
+#include <QLatin1String>
+#include <QMutexLocker>
+
+// stl library
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unistd.h>
+
+static_assert(sizeof(SphereArchiveEntry) == 32, "The archive entry has to be packed on 32 bytes");
+
+// Layout of the archive
+static const char archive_magic[8] = { 'S', 'N', 'C', 'S', 'P', 'H', 'R', '1' };
+static const quint32 record_magic = 0x43455253;  // "SREC"
+static const quint32 footer_magic = 0x58444953;  // "SIDX"
+
+struct RecordHeader {
+  quint32 magic;
+  quint32 reserved;
+  SphereArchiveEntry entry;
+};
+
+struct ArchiveFooter {
+  quint32 magic;
+  quint32 reserved;
+  quint64 index_offset;
+  quint64 count;
+};
+
+// Name of a zoom or focus position, the code itself when it is unknown
+static QString position_name(const char* _key, const quint16 _code) {
+  return (_key != 0) ? QString(QLatin1String(_key)) : QString::number(_code, 16).toUpper().rightJustified(4, '0');
+}
+
+// Key of the pose of an entry
+static inline quint64 entry_key(const qint16 _pan_steps, const qint16 _tilt_steps, const quint16 _zoom_code, const quint16 _focus_code) {
+  const PtzPose pose = {_pan_steps, _tilt_steps, _zoom_code, _focus_code};
+  return PtzCodec::pose_key(pose);
+}
+
+// Check that the frame of an entry lies between the magic and _end, and can
+// be handed out as a QByteArray
+static inline bool entry_in_range(const SphereArchiveEntry& _entry, const quint64 _end) {
+  return (_entry.offset >= sizeof(archive_magic)) && (_entry.offset <= _end) && (_entry.length <= _end - _entry.offset) &&
+    (_entry.length <= static_cast<quint64> (std::numeric_limits<int>::max()));
+}
+
+// Read the index of a mapped archive, from the footer when the archive was
+// closed or by scanning the records otherwise. _end_of_records is the offset
+// where the next record has to be written.
+static bool read_archive_index(const uchar* _data, const qint64 _size, std::vector<SphereArchiveEntry>& _entries, qint64& _end_of_records) {
+  _entries.clear();
+  if ((_size < static_cast<qint64> (sizeof(archive_magic))) || (std::memcmp(_data, archive_magic, sizeof(archive_magic)) != 0))
+    return false;
+  // Closed archive - the footer gives the index
+  if (_size >= static_cast<qint64> (sizeof(archive_magic) + sizeof(ArchiveFooter))) {
+    ArchiveFooter footer;
+    std::memcpy(&footer, _data + _size - sizeof(ArchiveFooter), sizeof(ArchiveFooter));
+    // Written as differences, a corrupt count or offset can not overflow
+    const quint64 space = static_cast<quint64> (_size) - sizeof(ArchiveFooter);
+    const quint64 index_size = footer.count * sizeof(SphereArchiveEntry);
+    if ((footer.magic == footer_magic) && (footer.count <= space / sizeof(SphereArchiveEntry)) && (footer.index_offset == space - index_size)) {
+      _entries.resize(footer.count);
+      if (footer.count > 0)
+	std::memcpy(&_entries[0], _data + footer.index_offset, index_size);
+      // The frames lie before the index, otherwise the records are scanned
+      bool valid = true;
+      for (size_t i = 0; valid && (i < _entries.size()); ++i)
+	valid = entry_in_range(_entries[i], footer.index_offset);
+      if (valid) {
+	_end_of_records = footer.index_offset;
+	return true;
+      }
+      std::cout << "The index of the archive is corrupt !!! Scanning the records !!!" << std::endl;
+      _entries.clear();
+    }
+  }
+  // Otherwise scan the records, a truncated last record is dropped
+  qint64 offset = sizeof(archive_magic);
+  while (offset + static_cast<qint64> (sizeof(RecordHeader)) <= _size) {
+    RecordHeader header;
+    std::memcpy(&header, _data + offset, sizeof(RecordHeader));
+    if ((header.magic != record_magic) || (header.entry.offset != static_cast<quint64> (offset + sizeof(RecordHeader))) ||
+	(!entry_in_range(header.entry, static_cast<quint64> (_size))))
+      break;
+    _entries.push_back(header.entry);
+    offset = header.entry.offset + header.entry.length;
+  }
+  _end_of_records = offset;
+  return true;
+}
+
+SphereArchiveWriter::SphereArchiveWriter(const QString& _filename) :
+  file(_filename) {
+  if (!file.open(QIODevice::ReadWrite)) {
+    std::cout << "Error while opening the archive " << _filename.toStdString() << std::endl;
+    return;
+  }
+  // New archive
+  if (file.size() == 0) {
+    file.write(archive_magic, sizeof(archive_magic));
+    return;
+  }
+  // Existing archive - recover the entries and drop the previous index
+  qint64 end_of_records = 0;
+  uchar* mapping = file.map(0, file.size());
+  const bool valid = (mapping != 0) && read_archive_index(mapping, file.size(), entries, end_of_records);
+  if (mapping != 0)
+    file.unmap(mapping);
+  if (!valid) {
+    std::cout << "The file " << _filename.toStdString() << " is not a sphere archive" << std::endl;
+    file.close();
+    return;
+  }
+  file.resize(end_of_records);
+  file.seek(end_of_records);
+}
+
+// Write the index and close the archive
+SphereArchiveWriter::~SphereArchiveWriter() {
+  close();
+}
+
+// Append a frame
+bool SphereArchiveWriter::append(const SphereArchiveEntry& _entry, const QByteArray& _data) {
+  QMutexLocker locker(&mutex);
+  if (!file.isOpen())
+    return false;
+  RecordHeader header;
+  header.magic = record_magic;
+  header.reserved = 0;
+  header.entry = _entry;
+  header.entry.offset = file.pos() + sizeof(RecordHeader);
+  header.entry.length = _data.size();
+  if ((file.write(reinterpret_cast<const char*> (&header), sizeof(RecordHeader)) != sizeof(RecordHeader)) ||
+      (file.write(_data.constData(), _data.size()) != _data.size())) {
+    std::cout << "Error while writting in the archive" << std::endl;
+    return false;
+  }
+  entries.push_back(header.entry);
+  return true;
+}
+
+// Force the written frames to the disk
+void SphereArchiveWriter::sync() {
+  QMutexLocker locker(&mutex);
+  if (!file.isOpen())
+    return;
+  file.flush();
+  ::fsync(file.handle());
+}
+
+// Write the index and the footer
+void SphereArchiveWriter::close() {
+  QMutexLocker locker(&mutex);
+  if (!file.isOpen())
+    return;
+  ArchiveFooter footer;
+  footer.magic = footer_magic;
+  footer.reserved = 0;
+  footer.index_offset = file.pos();
+  footer.count = entries.size();
+  if (!entries.empty())
+    file.write(reinterpret_cast<const char*> (&entries[0]), entries.size() * sizeof(SphereArchiveEntry));
+  file.write(reinterpret_cast<const char*> (&footer), sizeof(ArchiveFooter));
+  file.close();
+}
+
+SphereArchiveReader::SphereArchiveReader(const QString& _filename) :
+  file(_filename), mapping(0), mapping_size(0) {
+  if (!file.open(QIODevice::ReadOnly)) {
+    std::cout << "Error while opening the archive " << _filename.toStdString() << std::endl;
+    return;
+  }
+  mapping_size = file.size();
+  mapping = file.map(0, mapping_size);
+  if ((mapping == 0) || (!load_index())) {
+    std::cout << "The file " << _filename.toStdString() << " is not a sphere archive" << std::endl;
+    if (mapping != 0)
+      file.unmap(mapping);
+    mapping = 0;
+    entries.clear();
+  }
+}
+
+// Unmap the archive
+SphereArchiveReader::~SphereArchiveReader() {
+  if (mapping != 0)
+    file.unmap(mapping);
+}
+
+// Read the index and build the lookup by pose
+bool SphereArchiveReader::load_index() {
+  qint64 end_of_records = 0;
+  if (!read_archive_index(mapping, mapping_size, entries, end_of_records))
+    return false;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const SphereArchiveEntry& e = entries[i];
+    const quint64 key = entry_key(e.pan_steps, e.tilt_steps, e.zoom_code, e.focus_code);
+    auto it = pose_index.find(key);
+    if ((it == pose_index.end()) || (entries[it.value()].timestamp <= e.timestamp))
+      pose_index.insert(key, static_cast<int> (i));
+  }
+  return true;
+}
+
+// Access to a frame without copy
+QByteArray SphereArchiveReader::frame(const int _index) const {
+  // The entries are checked when loaded, a QByteArray holds at most INT_MAX bytes
+  if (entries[_index].length > static_cast<quint64> (std::numeric_limits<int>::max()))
+    return QByteArray();
+  return QByteArray::fromRawData(reinterpret_cast<const char*> (frame_data(_index)), static_cast<int> (entries[_index].length));
+}
+
+// Index of the latest frame taken at a pose
+int SphereArchiveReader::find(const qint16 _pan_steps, const qint16 _tilt_steps, const quint16 _zoom_code, const quint16 _focus_code) const {
+  return pose_index.value(entry_key(_pan_steps, _tilt_steps, _zoom_code, _focus_code), -1);
+}
+
+// Index of the frame closest to a direction in degrees
+int SphereArchiveReader::find_nearest(const double _pan, const double _tilt) const {
+  int best = -1;
+  double best_distance = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const double pan = PtzCodec::steps_to_pan(entries[i].pan_steps);
+    const double tilt = PtzCodec::steps_to_tilt(entries[i].tilt_steps);
+    const double d_pan = std::remainder(pan - _pan, PtzCodec::pan_angle);
+    const double distance = d_pan * d_pan + (tilt - _tilt) * (tilt - _tilt);
+    if (distance < best_distance) {
+      best_distance = distance;
+      best = static_cast<int> (i);
+    }
+  }
+  return best;
+}
+
+// Export the frames with the layout of the acquisitions
+bool SphereArchiveReader::export_to_directory(const QString& _directory) const {
+  QDir directory(_directory);
+  if (!directory.exists())
+    directory.mkpath(".");
+  bool success = true;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const SphereArchiveEntry& e = entries[i];
+    const double pan = PtzCodec::steps_to_pan(e.pan_steps);
+    const double tilt = PtzCodec::steps_to_tilt(e.tilt_steps);
+    QString filename = QString::number(tilt) + "-" + QString::number(pan) + "-" + position_name(PtzCodec::zoom_key(e.zoom_code), e.zoom_code) + "-" + position_name(PtzCodec::focus_key(e.focus_code), e.focus_code) + "-" + QDateTime::fromMSecsSinceEpoch(e.timestamp).toUTC().toString(Qt::ISODate) + ".jpg";
+    QFile output(directory.filePath(filename));
+    if ((!output.open(QIODevice::WriteOnly)) || (output.write(reinterpret_cast<const char*> (frame_data(static_cast<int> (i))), e.length) != static_cast<qint64> (e.length))) {
+      std::cout << "Error while writting the image file" << std::endl;
+      success = false;
+    }
+    output.close();
+  }
+  return success;
+}
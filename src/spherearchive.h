@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2015
+ * Guillaume Lemaitre (g.lemaitre58@gmail.com)
+ * Francois Rameau
+ * Devesh Adlakha
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef SPHEREARCHIVE_H_
+#define SPHEREARCHIVE_H_
+
+// stl library
+#include <vector>
+
+// qt library
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+
+// The archive is a single file made of records, each one being a record
+// header followed by the JPEG payload. When the archive is closed, the index
+// of all the entries and a footer are appended:
+//
+//   [record][record]...[record][entry][entry]...[entry][footer]
+//
+// An archive without footer - e.g. the process died - is recovered by
+// scanning the records. The values are stored in the byte order of the host.
+
+// Entry of the index - 32 bytes
+struct SphereArchiveEntry {
+  // Position in motor steps and zoom and focus codes as sent to the camera
+  qint16 pan_steps;
+  qint16 tilt_steps;
+  quint16 zoom_code;
+  quint16 focus_code;
+  // Time of the acquisition in ms since epoch, UTC
+  qint64 timestamp;
+  // Position and size of the JPEG payload in the archive
+  quint64 offset;
+  quint64 length;
+};
+
+class SphereArchiveWriter
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - an existing archive is reopened and extended
+  explicit SphereArchiveWriter(const QString& _filename);
+  // Destructor - write the index and close the archive
+  ~SphereArchiveWriter();
+
+  inline bool is_open() const { return file.isOpen(); }
+  inline QString get_filename() const { return file.fileName(); }
+
+  // Append a frame, thread safe. The offset and length are filled here.
+  bool append(const SphereArchiveEntry& _entry, const QByteArray& _data);
+  // Force the written frames to the disk, thread safe
+  void sync();
+  // Write the index and the footer, the archive can not be extended after
+  void close();
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  QFile file;
+  QMutex mutex;
+  std::vector<SphereArchiveEntry> entries;
+};
+
+class SphereArchiveReader
+{
+  /* PUBLIC MEMBERS AND FUNCTIONS */
+
+public:
+  // Constructor - the archive is mapped in memory
+  explicit SphereArchiveReader(const QString& _filename);
+  // Destructor - unmap the archive
+  ~SphereArchiveReader();
+
+  inline bool is_open() const { return (mapping != 0); }
+  // Number of frames in the archive
+  inline int size() const { return static_cast<int> (entries.size()); }
+  inline const SphereArchiveEntry& entry(const int _index) const { return entries[_index]; }
+
+  // Access to a frame without copy - the data stays valid while the reader
+  // exists
+  inline const uchar* frame_data(const int _index) const { return mapping + entries[_index].offset; }
+  QByteArray frame(const int _index) const;
+
+  // Index of the latest frame taken at a pose, -1 when there is none
+  int find(const qint16 _pan_steps, const qint16 _tilt_steps, const quint16 _zoom_code, const quint16 _focus_code) const;
+  // Index of the frame closest to a direction in degrees, -1 when empty
+  int find_nearest(const double _pan, const double _tilt) const;
+
+  // Export the frames to a directory with the layout of the acquisitions:
+  // <tilt>-<pan>-<zoom>-<focus>-<time>.jpg
+  bool export_to_directory(const QString& _directory) const;
+
+  /* PRIVATE MEMBERS AND FUNCTIONS */
+
+private:
+  QFile file;
+  uchar* mapping;
+  qint64 mapping_size;
+  std::vector<SphereArchiveEntry> entries;
+  // Index of the latest frame for each pose
+  QHash<quint64, int> pose_index;
+
+  // Read the index from the footer or by scanning the records
+  bool load_index();
+};
+
+#endif  // SPHEREARCHIVE_H_